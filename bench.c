@@ -0,0 +1,555 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/* author: Matthias Meißner (geige.matze@gmail.com) */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "cstr.h"
+
+#include <stdio.h>
+#include <time.h>
+
+double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* keeps the compiler from dropping the benchmarked computation */
+volatile size_t bench_sink;
+
+#define BENCH_NS_PER_OP(result, iterations, body)                \
+    do                                                           \
+    {                                                            \
+        double __bench_start = bench_now();                      \
+        for (size_t __i = 0; __i < (size_t)(iterations); __i++) \
+        {                                                        \
+            body;                                                \
+        }                                                        \
+        result = (bench_now() - __bench_start) / (iterations);   \
+    } while (0)
+
+char bench_text_byte(size_t i)
+{
+    return (char)('a' + (i * 7 + i / 11) % 26);
+}
+
+void bench_find_first(void)
+{
+    enum { haystack_len = 4096, iterations = 20000 };
+    static char haystack[haystack_len];
+
+    for (size_t i = 0; i < haystack_len; i++)
+        haystack[i] = bench_text_byte(i);
+
+    const size_t needle_lengths[] = {1, 2, 4, 8, 16, 32, 64, 128};
+
+    puts("find_first, 4 KiB haystack, needle at the end (ns/op)");
+    printf("%8s %12s %12s %12s\n", "needle", "find_first", "kmp", "memmem");
+
+    for (size_t n = 0; n < sizeof(needle_lengths) / sizeof(*needle_lengths); n++)
+    {
+        const size_t needle_len = needle_lengths[n];
+        char needle[128];
+
+        /* the needle only occurs as the suffix of the haystack */
+        memcpy(needle, &haystack[haystack_len - needle_len], needle_len);
+        needle[0] = '#';
+        haystack[haystack_len - needle_len] = '#';
+
+        cstr hay = {haystack_len, haystack}, pat = {needle_len, needle};
+        double simd_ns, kmp_ns, memmem_ns;
+
+        BENCH_NS_PER_OP(simd_ns, iterations,
+                        bench_sink += len(cstr_find_first(hay, pat)));
+        BENCH_NS_PER_OP(kmp_ns, iterations,
+                        bench_sink += len(cstr_find_first_kmp(hay, pat)));
+        BENCH_NS_PER_OP(memmem_ns, iterations,
+                        bench_sink += (size_t)memmem(haystack, haystack_len, needle, needle_len));
+
+        printf("%8zu %12.1f %12.1f %12.1f\n", needle_len, simd_ns, kmp_ns, memmem_ns);
+
+        haystack[haystack_len - needle_len] = bench_text_byte(haystack_len - needle_len);
+    }
+}
+
+void bench_multi_pattern(void)
+{
+    enum { haystack_len = 4096, iterations = 200 };
+    static char haystack[haystack_len];
+    static char keyword_storage[1024][8];
+    static cstr keywords[1024];
+
+    for (size_t i = 0; i < haystack_len; i++)
+        haystack[i] = bench_text_byte(i);
+
+    /* keywords that do not occur in the haystack, so every needle is scanned in full */
+    for (size_t k = 0; k < 1024; k++)
+    {
+        for (size_t i = 0; i < 8; i++)
+            keyword_storage[k][i] = bench_text_byte(k * 31 + i * 5);
+        keyword_storage[k][7] = '#';
+        keywords[k] = (cstr){8, keyword_storage[k]};
+    }
+
+    const size_t keyword_counts[] = {1, 10, 100, 1000};
+    cstr hay = {haystack_len, haystack};
+
+    puts("\nmulti pattern, 4 KiB haystack, no match (ns/op)");
+    printf("%8s %12s %12s\n", "needles", "automaton", "contains");
+
+    for (size_t n = 0; n < sizeof(keyword_counts) / sizeof(*keyword_counts); n++)
+    {
+        const size_t count = keyword_counts[n];
+        cstr_multi_pattern pattern = cstr_multi_pattern_compile(keywords, count, malloc_wrapper);
+        double automaton_ns, contains_ns;
+
+        BENCH_NS_PER_OP(automaton_ns, iterations,
+                        bench_sink += cstr_multi_pattern_contains(&pattern, hay));
+        BENCH_NS_PER_OP(contains_ns, iterations,
+                        for (size_t k = 0; k < count; k++)
+                            bench_sink += cstr_contains(hay, keywords[k]));
+
+        printf("%8zu %12.1f %12.1f\n", count, automaton_ns, contains_ns);
+
+        cstr_multi_pattern_free(pattern);
+    }
+}
+
+void bench_cstring_append(void)
+{
+    enum { total_len = 1 << 22, repetitions = 4 };
+    static char chunk[4096];
+    const size_t chunk_sizes[] = {1, 8, 64, 512, 4096};
+
+    memset(chunk, 'x', sizeof(chunk));
+
+    puts("\ncstring_append, 4 MiB string from chunks (MB/s)");
+    printf("%8s %12s %12s\n", "chunk", "geometric", "exact");
+
+    for (size_t n = 0; n < sizeof(chunk_sizes) / sizeof(*chunk_sizes); n++)
+    {
+        const cstr piece = {chunk_sizes[n], chunk};
+        const size_t appends = total_len / chunk_sizes[n];
+        double geometric_ns, exact_ns;
+
+        BENCH_NS_PER_OP(geometric_ns, repetitions, {
+            cstring s = cstring_from("", malloc_wrapper);
+            for (size_t i = 0; i < appends; i++)
+                cstring_append(&s, piece);
+            bench_sink += len(s);
+            cstring_free(s);
+        });
+
+        /* the previous behaviour: capacity grows to exactly what is needed */
+        BENCH_NS_PER_OP(exact_ns, repetitions, {
+            cstring s = cstring_from("", malloc_wrapper);
+            for (size_t i = 0; i < appends; i++)
+            {
+                cstring_reserve(&s, len(s) + len(piece));
+                cstring_append(&s, piece);
+            }
+            bench_sink += len(s);
+            cstring_free(s);
+        });
+
+        printf("%8zu %12.1f %12.1f\n", chunk_sizes[n],
+               total_len / geometric_ns * 1e3, total_len / exact_ns * 1e3);
+    }
+}
+
+void bench_arena(void)
+{
+    enum { strings_per_request = 1000, requests = 2000 };
+    static cstring strings[strings_per_request];
+    cstr_arena arena;
+    double malloc_ns, arena_ns;
+
+    cstr_arena_init(&arena, 1 << 16);
+    allocator arena_alloc = cstr_arena_allocator(&arena);
+
+    BENCH_NS_PER_OP(malloc_ns, requests, {
+        for (size_t i = 0; i < strings_per_request; i++)
+        {
+            strings[i] = cstring_from("GET /index.html", malloc_wrapper);
+            cstring_append(&strings[i], " HTTP/1.1");
+            cstring_append(&strings[i], "\r\n");
+        }
+        for (size_t i = 0; i < strings_per_request; i++)
+            cstring_free(strings[i]);
+    });
+
+    BENCH_NS_PER_OP(arena_ns, requests, {
+        for (size_t i = 0; i < strings_per_request; i++)
+        {
+            strings[i] = cstring_from("GET /index.html", arena_alloc);
+            cstring_append(&strings[i], " HTTP/1.1");
+            cstring_append(&strings[i], "\r\n");
+        }
+        cstr_arena_reset(&arena);
+    });
+
+    puts("\nallocator, 1000 short cstrings per request (ns/request)");
+    printf("%12s %12s\n", "malloc", "arena");
+    printf("%12.1f %12.1f\n", malloc_ns, arena_ns);
+
+    cstr_arena_free(&arena);
+}
+
+void bench_split(void)
+{
+    enum { input_len = 1 << 20, iterations = 50 };
+    static char input[input_len];
+    double byte_ns, set_ns, for_iter_ns;
+
+    for (size_t i = 0; i < input_len; i++)
+        input[i] = i % 64 == 63 ? '\n' : i % 8 == 7 ? ',' : bench_text_byte(i);
+
+    cstr csv = {input_len, input};
+    cstr token;
+
+    BENCH_NS_PER_OP(byte_ns, iterations, {
+        cstr_split split = cstr_split_on_byte(csv, ',');
+        while (cstr_split_next(&split, &token))
+            bench_sink += len(token);
+    });
+
+    BENCH_NS_PER_OP(set_ns, iterations, {
+        cstr_split split = cstr_split_on_any(csv, cstr(",\n"));
+        while (cstr_split_next(&split, &token))
+            bench_sink += len(token);
+    });
+
+    BENCH_NS_PER_OP(for_iter_ns, iterations, {
+        FOR_ITER_CSTR(field, csv, ",")
+        bench_sink += len(field);
+    });
+
+    puts("\nsplit, 1 MiB of CSV with 8 byte fields (MB/s)");
+    printf("%12s %12s %12s\n", "byte", "set", "FOR_ITER");
+    printf("%12.1f %12.1f %12.1f\n", input_len / byte_ns * 1e3,
+           input_len / set_ns * 1e3, input_len / for_iter_ns * 1e3);
+}
+
+void bench_match(void)
+{
+    enum { iterations = 1000000 };
+    static char a[256], b[256];
+    const size_t lengths[] = {8, 16, 64, 256};
+
+    for (size_t i = 0; i < sizeof(a); i++)
+        a[i] = b[i] = bench_text_byte(i);
+
+    puts("\ncstr_match against memcmp (ns/op)");
+    printf("%8s %10s %12s %12s %12s %12s\n", "length", "mismatch",
+           "match", "memcmp", "compare", "ignore_case");
+
+    for (size_t n = 0; n < sizeof(lengths) / sizeof(*lengths); n++)
+    {
+        const size_t length = lengths[n];
+        const size_t positions[] = {length, 0, length - 1};
+        const char *position_names[] = {"none", "early", "late"};
+
+        for (size_t p = 0; p < 3; p++)
+        {
+            /* volatile lengths keep the compiler from specializing on them */
+            volatile size_t length_a = length, length_b = length;
+            double match_ns, memcmp_ns, compare_ns, ignore_case_ns;
+
+            if (positions[p] < length)
+                b[positions[p]] = '#';
+
+            BENCH_NS_PER_OP(match_ns, iterations,
+                            bench_sink += cstr_match((cstr){length_a, a}, (cstr){length_b, b}));
+            BENCH_NS_PER_OP(memcmp_ns, iterations,
+                            bench_sink += length_a == length_b && memcmp(a, b, length_a) == 0);
+            BENCH_NS_PER_OP(compare_ns, iterations,
+                            bench_sink += (size_t)cstr_compare((cstr){length_a, a}, (cstr){length_b, b}));
+            BENCH_NS_PER_OP(ignore_case_ns, iterations,
+                            bench_sink += cstr_match_ignore_case((cstr){length_a, a}, (cstr){length_b, b}));
+
+            printf("%8zu %10s %12.2f %12.2f %12.2f %12.2f\n", length, position_names[p],
+                   match_ns, memcmp_ns, compare_ns, ignore_case_ns);
+
+            b[positions[p] < length ? positions[p] : 0] = a[positions[p] < length ? positions[p] : 0];
+        }
+    }
+}
+
+void bench_map(void)
+{
+    enum { max_keys = 1000000 };
+    static char key_storage[max_keys][16];
+    static cstr keys[max_keys], missing[max_keys];
+    const size_t key_counts[] = {1000, 100000, 1000000};
+
+    for (size_t i = 0; i < max_keys; i++)
+    {
+        int length = sprintf(key_storage[i], "user:%zu", i * 2654435761u % 1000003);
+        keys[i] = (cstr){(size_t)length, key_storage[i]};
+        missing[i] = (cstr){(size_t)length - 1, key_storage[i] + 1};
+    }
+
+    puts("\ncstr_map (ns/op)");
+    printf("%8s %12s %12s %12s %12s\n", "keys", "hash", "insert", "hit", "miss");
+
+    for (size_t n = 0; n < sizeof(key_counts) / sizeof(*key_counts); n++)
+    {
+        const size_t count = key_counts[n];
+        cstr_map map = cstr_map_new(malloc_wrapper);
+        double hash_ns, insert_ns, hit_ns, miss_ns;
+
+        BENCH_NS_PER_OP(hash_ns, count, bench_sink += cstr_hash(keys[__i]));
+        BENCH_NS_PER_OP(insert_ns, count, cstr_map_insert(&map, keys[__i], &keys[__i]));
+        BENCH_NS_PER_OP(hit_ns, count, bench_sink += cstr_map_get(&map, keys[__i]) != NULL);
+        BENCH_NS_PER_OP(miss_ns, count, bench_sink += cstr_map_get(&map, missing[__i]) != NULL);
+
+        printf("%8zu %12.1f %12.1f %12.1f %12.1f\n", count, hash_ns, insert_ns, hit_ns, miss_ns);
+
+        cstr_map_free(map);
+    }
+}
+
+void bench_numbers(void)
+{
+    enum { count = 1000000 };
+    static char storage[count][24];
+    static cstr tokens[count];
+    char buffer[32];
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t value = (uint64_t)i * 2654435761u * 40503u;
+        int length = i % 2 == 0 ? snprintf(storage[i], 24, "%lld", (long long)(value >> (i % 40)))
+                                : snprintf(storage[i], 24, "%.3f", (double)(value % 10000000) / 1000);
+        tokens[i] = (cstr){(size_t)length, storage[i]};
+    }
+
+    cstring out = cstring_from("", malloc_wrapper);
+    double parse_ns, strtoll_ns, format_ns, snprintf_ns;
+    int64_t integer;
+    double real;
+
+    puts("\nnumbers, parse and format (ns/op)");
+    printf("%8s %12s %12s %12s %12s\n", "type", "parse", "strto*", "append", "snprintf");
+
+    /* the baselines need a terminated copy, as they would for a cstr token */
+    BENCH_NS_PER_OP(parse_ns, count / 2,
+                    cstr_parse_i64(tokens[2 * __i], &integer); bench_sink += (size_t)integer);
+    BENCH_NS_PER_OP(strtoll_ns, count / 2,
+                    memcpy(buffer, ptr(tokens[2 * __i]), len(tokens[2 * __i]));
+                    buffer[len(tokens[2 * __i])] = '\0';
+                    bench_sink += (size_t)strtoll(buffer, NULL, 10));
+    BENCH_NS_PER_OP(format_ns, count, cstring_clear(&out); cstring_append_i64(&out, (int64_t)__i * 7919));
+    BENCH_NS_PER_OP(snprintf_ns, count, bench_sink += (size_t)snprintf(buffer, 32, "%lld", (long long)__i * 7919));
+    printf("%8s %12.1f %12.1f %12.1f %12.1f\n", "i64", parse_ns, strtoll_ns, format_ns, snprintf_ns);
+
+    BENCH_NS_PER_OP(parse_ns, count / 2,
+                    cstr_parse_f64(tokens[2 * __i + 1], &real); bench_sink += (size_t)real);
+    BENCH_NS_PER_OP(strtoll_ns, count / 2,
+                    memcpy(buffer, ptr(tokens[2 * __i + 1]), len(tokens[2 * __i + 1]));
+                    buffer[len(tokens[2 * __i + 1])] = '\0';
+                    bench_sink += (size_t)strtod(buffer, NULL));
+    BENCH_NS_PER_OP(format_ns, count, cstring_clear(&out); cstring_append_f64(&out, (double)__i / 8));
+    BENCH_NS_PER_OP(snprintf_ns, count, bench_sink += (size_t)snprintf(buffer, 32, "%.17g", (double)__i / 8));
+    printf("%8s %12.1f %12.1f %12.1f %12.1f\n", "f64", parse_ns, strtoll_ns, format_ns, snprintf_ns);
+
+    cstring_free(out);
+}
+
+void bench_utf8(void)
+{
+    enum { input_len = 1 << 20, iterations = 200 };
+    static char ascii[input_len], mixed[input_len];
+    const char *pieces[] = {"a", "b", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80"};
+
+    for (size_t i = 0; i < input_len; i++)
+        ascii[i] = bench_text_byte(i);
+
+    for (size_t i = 0, n = 0; i + 4 <= input_len; n++)
+    {
+        const char *piece = pieces[(n * 7 + n / 3) % 5];
+        memcpy(mixed + i, piece, strlen(piece));
+        i += strlen(piece);
+    }
+
+    cstr inputs[] = {{input_len, ascii}, {input_len, mixed}};
+    const char *names[] = {"ascii", "mixed"};
+
+    puts("\nutf8, 1 MiB input (us/op)");
+    printf("%8s %12s %12s %12s %12s\n", "input", "is_ascii", "validate", "scalar", "length");
+
+    for (size_t n = 0; n < 2; n++)
+    {
+        double ascii_ns, validate_ns, scalar_ns, length_ns;
+        const unsigned char *bytes = (const unsigned char *)ptr(inputs[n]);
+
+        BENCH_NS_PER_OP(ascii_ns, iterations, bench_sink += cstr_is_ascii(inputs[n]));
+        BENCH_NS_PER_OP(validate_ns, iterations, bench_sink += cstr_utf8_validate(inputs[n]));
+        BENCH_NS_PER_OP(scalar_ns, iterations,
+                        bench_sink += cstr_utf8_validate_scalar(bytes, len(inputs[n]), 0));
+        BENCH_NS_PER_OP(length_ns, iterations, bench_sink += cstr_utf8_length(inputs[n]));
+
+        printf("%8s %12.1f %12.1f %12.1f %12.1f\n", names[n], ascii_ns / 1e3, validate_ns / 1e3,
+               scalar_ns / 1e3, length_ns / 1e3);
+    }
+}
+
+/* replace-all built by hand from cstr_find_first and cstring_append */
+size_t bench_replace_naive(cstr text)
+{
+    cstring string = cstring_from(text, malloc_wrapper);
+    cstring result = cstring_from("", malloc_wrapper);
+    cstr rest = cstr(string);
+    cstr found;
+
+    while (len(found = cstr_find_first(rest, cstr(" "))) != 0)
+    {
+        cstring_append(&result, ((cstr){(size_t)(ptr(found) - ptr(rest)), ptr(rest)}));
+        cstring_append(&result, ", ");
+        rest = (cstr){(size_t)(end(rest) - end(found)), end(found)};
+    }
+    cstring_append(&result, rest);
+
+    size_t length = result.length;
+    cstring_free(string);
+    cstring_free(result);
+    return length;
+}
+
+void bench_transform(void)
+{
+    enum { input_len = 1 << 20, iterations = 100 };
+    static char input[input_len];
+
+    for (size_t i = 0; i < input_len; i++)
+        input[i] = i % 61 == 0 ? ' ' : bench_text_byte(i) - (i % 3 == 0 ? 'a' - 'A' : 0);
+
+    cstr text = {input_len, input};
+    cstring out = cstring_from("", malloc_wrapper);
+    double lower_ns, naive_lower_ns, replace_ns, naive_replace_ns;
+
+    BENCH_NS_PER_OP(lower_ns, iterations, cstring_clear(&out); cstring_append_ascii_lower(&out, text));
+    BENCH_NS_PER_OP(naive_lower_ns, iterations,
+                    cstring_clear(&out);
+                    for (size_t i = 0; i < input_len; i++)
+                    {
+                        char c = (char)CSTR_ASCII_LOWER(input[i]);
+                        cstring_append(&out, ((cstr){1, &c}));
+                    });
+
+    /* replace spaces by a longer separator, against cstr_find_first and appending piece by piece */
+    BENCH_NS_PER_OP(replace_ns, iterations,
+                    cstring string = cstring_from(text, malloc_wrapper);
+                    cstring_replace_all(&string, " ", ", ");
+                    bench_sink += string.length;
+                    cstring_free(string));
+    BENCH_NS_PER_OP(naive_replace_ns, iterations, bench_sink += bench_replace_naive(text));
+
+    puts("\ntransform, 1 MiB input (us/op)");
+    printf("%12s %12s %12s %12s\n", "lower", "bytewise", "replace_all", "appends");
+    printf("%12.1f %12.1f %12.1f %12.1f\n", lower_ns / 1e3, naive_lower_ns / 1e3, replace_ns / 1e3,
+           naive_replace_ns / 1e3);
+
+    cstring_free(out);
+}
+
+void bench_join(void)
+{
+    enum { iterations = 200000, max_fields = 32 };
+    static char storage[max_fields][16];
+    static cstr fields[max_fields];
+
+    for (size_t i = 0; i < max_fields; i++)
+    {
+        size_t length = 3 + i % 11;
+        for (size_t j = 0; j < length; j++)
+            storage[i][j] = bench_text_byte(i * 17 + j);
+        fields[i] = (cstr){length, storage[i]};
+    }
+
+    const size_t field_counts[] = {4, 16, 32};
+
+    puts("\njoin, csv row (ns/op)");
+    printf("%8s %12s %12s\n", "fields", "join", "appends");
+
+    for (size_t n = 0; n < sizeof(field_counts) / sizeof(*field_counts); n++)
+    {
+        const size_t count = field_counts[n];
+        double join_ns, append_ns;
+
+        BENCH_NS_PER_OP(join_ns, iterations,
+                        cstring row = cstring_join(fields, count, ",", malloc_wrapper);
+                        bench_sink += row.length;
+                        cstring_free(row));
+        BENCH_NS_PER_OP(append_ns, iterations,
+                        cstring row = cstring_from("", malloc_wrapper);
+                        for (size_t i = 0; i < count; i++)
+                        {
+                            if (i != 0)
+                                cstring_append(&row, ",");
+                            cstring_append(&row, fields[i]);
+                        }
+                        bench_sink += row.length;
+                        cstring_free(row));
+
+        printf("%8zu %12.1f %12.1f\n", count, join_ns, append_ns);
+    }
+}
+
+void bench_parallel_count(void)
+{
+    enum { haystack_len = 1 << 28, iterations = 4 };
+    char *haystack = (char *)malloc(haystack_len);
+
+    for (size_t i = 0; i < haystack_len; i++)
+        haystack[i] = bench_text_byte(i);
+
+    cstr hay = {haystack_len, haystack};
+    cstr_pattern pattern = cstr_pattern_compile(cstr("zyxwvut"));
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = online > 4 ? (size_t)online : 4;
+    double sequential_ns;
+
+    BENCH_NS_PER_OP(sequential_ns, iterations, bench_sink += cstr_pattern_count(&pattern, hay));
+
+    puts("\nparallel count, 256 MiB haystack (ms/op)");
+    printf("%8s %12s %12s\n", "threads", "count", "speedup");
+    printf("%8s %12.1f %12.2f\n", "seq", sequential_ns / 1e6, 1.0);
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        double parallel_ns;
+
+        BENCH_NS_PER_OP(parallel_ns, iterations,
+                        bench_sink += cstr_pattern_count_parallel(&pattern, hay, threads));
+
+        printf("%8zu %12.1f %12.2f\n", threads, parallel_ns / 1e6, sequential_ns / parallel_ns);
+    }
+
+    free(haystack);
+}
+
+int main(void)
+{
+    bench_find_first();
+    bench_multi_pattern();
+    bench_cstring_append();
+    bench_arena();
+    bench_split();
+    bench_match();
+    bench_map();
+    bench_numbers();
+    bench_utf8();
+    bench_transform();
+    bench_join();
+    bench_parallel_count();
+    return 0;
+}
@@ -6,21 +6,74 @@
 
 /* author: Matthias Meißner (geige.matze@gmail.com) */
 
+/*
+ * pthread_rwlock_t, madvise and friends are POSIX, not ISO C, so a strict
+ * -std=c11 build has to ask for them. This only takes effect if cstr.h is
+ * included before any system header.
+ */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+#include <errno.h>
+#include <locale.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__cplusplus) && __cplusplus >= 201703L
+#include <string_view>
+#define CSTR_STRING_VIEW
+#endif
+
+#ifdef __cplusplus
+#define CSTR_THREAD_LOCAL thread_local
+#else
+#define CSTR_THREAD_LOCAL _Thread_local
+#endif
+
+#if !defined(CSTR_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define CSTR_X86_SIMD
+#include <immintrin.h>
+#endif
 
 typedef struct allocator
 {
-    void *(*run)(void *ptr_to_free, size_t size);
+    void *(*run)(void *context, void *ptr_to_free, size_t size);
+    void *context;
 } allocator;
 
 typedef struct cstr
 {
     size_t length;
     const char *inner;
+
+#ifdef CSTR_STRING_VIEW
+    constexpr operator std::string_view() const noexcept
+    {
+        return std::string_view(inner, length);
+    }
+#endif
 } cstr;
 
+/*
+ * The contents always live in the allocator's memory, so a cstring can be
+ * copied, passed and returned by value like a cstr. Code that creates many
+ * short strings should reuse one buffer with cstring_assign, or hand out
+ * short strings from the size-class pool, rather than allocate per string.
+ */
 typedef struct cstring
 {
     size_t length;
@@ -29,19 +82,343 @@ typedef struct cstring
     allocator alloc;
 } cstring;
 
-const allocator malloc_wrapper = {&realloc};
+typedef enum cstr_search_kind
+{
+    cstr_search_empty,
+    cstr_search_byte,
+    cstr_search_sse2,
+    cstr_search_avx2,
+    cstr_search_horspool,
+} cstr_search_kind;
+
+/* a needle together with its precomputed search tables */
+typedef struct cstr_pattern
+{
+    cstr needle;
+    cstr_search_kind kind;
+    size_t shift[256];
+} cstr_pattern;
+
+typedef enum cstr_split_kind
+{
+    cstr_split_byte,
+    cstr_split_set,
+    cstr_split_pattern,
+} cstr_split_kind;
+
+/* sets of at most this many bytes are scanned with SIMD compares */
+#define CSTR_SPLIT_SIMD_SET 8
+
+/* iterator over the tokens between separators, yields views into the input */
+typedef struct cstr_split
+{
+    cstr rest;
+    cstr_split_kind kind;
+    size_t set_size;
+    char set_bytes[CSTR_SPLIT_SIMD_SET];
+    unsigned char set[32];
+    cstr_pattern pattern;
+} cstr_split;
+
+typedef struct cstr_map_entry
+{
+    uint64_t hash;
+    cstr key;
+    void *value;
+} cstr_map_entry;
+
+/*
+ * Open addressing hash map with linear probing from cstr keys to pointers.
+ * Keys are not copied and have to outlive the map. Each entry stores the
+ * hash of its key, so probing only compares keys on a full hash match, and
+ * growing never rehashes. A stored hash of 0 marks an empty slot.
+ */
+typedef struct cstr_map
+{
+    cstr_map_entry *entries;
+    size_t capacity;
+    size_t count;
+    allocator alloc;
+} cstr_map;
+
+typedef struct cstr_rope_chunk
+{
+    struct cstr_rope_chunk *next;
+    cstr data;
+    size_t capacity;
+} cstr_rope_chunk;
+
+/*
+ * String builder made of a list of chunks. Appending never moves data that
+ * is already in the rope: copied data goes into chunks of growing size,
+ * referenced data is linked in without copying at all.
+ */
+typedef struct cstr_rope
+{
+    cstr_rope_chunk *head;
+    cstr_rope_chunk *tail;
+    size_t length;
+    size_t chunk_count;
+    allocator alloc;
+} cstr_rope;
+
+typedef enum cstr_mmap_advice
+{
+    cstr_mmap_normal,
+    cstr_mmap_sequential,
+    cstr_mmap_random,
+    cstr_mmap_willneed,
+} cstr_mmap_advice;
+
+/* a read-only file mapping, contents is valid until cstr_munmap_file */
+typedef struct cstr_file_mapping
+{
+    cstr contents;
+    size_t mapped_length;
+} cstr_file_mapping;
+
+/*
+ * Buffered record reader for file descriptors. Records are views into a
+ * single reusable buffer and stay valid until the next call to
+ * cstr_reader_next. Bytes already searched for the delimiter are never
+ * searched again, even when a record spans several reads.
+ */
+typedef struct cstr_reader
+{
+    int fd;
+    char delimiter;
+    bool eof;
+    int error;
+    char *buffer;
+    size_t capacity;
+    size_t start;
+    size_t end;
+    size_t scanned;
+    allocator alloc;
+} cstr_reader;
+
+typedef struct cstr_utf8_iter
+{
+    cstr rest;
+} cstr_utf8_iter;
+
+typedef struct cstr_multi_match
+{
+    size_t needle_index;
+    size_t offset;
+} cstr_multi_match;
+
+/* Aho-Corasick automaton over byte classes, built from several needles */
+typedef struct cstr_multi_pattern
+{
+    size_t needle_count;
+    size_t state_count;
+    size_t class_count;
+    unsigned char byte_class[256];
+    size_t *needle_lengths;
+    size_t *needle_duplicate;
+    size_t *output;
+    unsigned *output_link;
+    unsigned *transitions;
+    allocator alloc;
+} cstr_multi_pattern;
+
+void *malloc_wrapper_run(void *context, void *ptr_to_free, size_t size)
+{
+    (void)context;
+
+    if (size == 0)
+    {
+        free(ptr_to_free);
+        return NULL;
+    }
+
+    return realloc(ptr_to_free, size);
+}
+
+const allocator malloc_wrapper = {&malloc_wrapper_run, NULL};
+
+typedef struct cstr_arena_block
+{
+    struct cstr_arena_block *next;
+    size_t capacity;
+    size_t used;
+} cstr_arena_block;
+
+/* bump allocator, everything it handed out is released at once by a reset */
+typedef struct cstr_arena
+{
+    cstr_arena_block *blocks;
+    size_t block_size;
+    char *last;
+} cstr_arena;
+
+/* power of two size classes from 16 bytes up to 64 KiB, larger requests go to malloc */
+#define CSTR_POOL_MIN_SHIFT 4
+#define CSTR_POOL_CLASSES 13
+
+typedef struct cstr_pool_stats
+{
+    size_t hits;
+    size_t misses;
+    size_t oversized;
+} cstr_pool_stats;
+
+typedef struct cstr_pool_cache
+{
+    void *free_list[CSTR_POOL_CLASSES];
+    size_t free_count[CSTR_POOL_CLASSES];
+    cstr_pool_stats stats;
+    bool registered;
+    struct cstr_pool_cache *next;
+    struct cstr_pool_cache *prev;
+} cstr_pool_cache;
+
+typedef struct cstr_pool_state
+{
+    pthread_mutex_t lock;
+    pthread_once_t once;
+    pthread_key_t thread_key;
+    void *free_list[CSTR_POOL_CLASSES];
+    size_t free_count[CSTR_POOL_CLASSES];
+    cstr_pool_stats retired_stats;
+    cstr_pool_cache *caches;
+} cstr_pool_state;
+
+cstr_pool_state cstr_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_ONCE_INIT, 0, {NULL}, {0}, {0, 0, 0}, NULL};
+CSTR_THREAD_LOCAL cstr_pool_cache cstr_pool_thread_cache;
+
+#define CSTR_INTERNER_SHARD_BITS 4
+#define CSTR_INTERNER_SHARDS (1 << CSTR_INTERNER_SHARD_BITS)
+
+typedef struct cstr_interner_shard
+{
+    pthread_rwlock_t lock;
+    cstr_map map;
+    cstr_arena arena;
+    cstr *strings;
+    size_t string_count;
+    size_t string_capacity;
+    size_t string_bytes;
+} cstr_interner_shard;
+
+/*
+ * Deduplicates strings into arena storage. Interned strings are canonical:
+ * two of them are equal if and only if their inner pointers are. Strings
+ * are spread over shards by hash, each guarded by its own reader-writer
+ * lock, so lookups of already interned strings run in parallel.
+ */
+typedef struct cstr_interner
+{
+    cstr_interner_shard shards[CSTR_INTERNER_SHARDS];
+} cstr_interner;
+
+typedef struct cstr_interner_stats
+{
+    size_t strings;
+    size_t string_bytes;
+    size_t allocated_bytes;
+} cstr_interner_stats;
 
 cstr cstr_id(cstr input) { return input; }
 
 cstr cstr_from_char_ptr(const char *input);
 cstr cstr_from_cstring(cstring input);
 cstr cstr_end(cstr input);
+size_t cstr_mismatch(const char *a, const char *b, size_t length);
+size_t cstr_mismatch_ignore_case(const char *a, const char *b, size_t length);
 bool cstr_match(cstr a, cstr b);
+bool cstr_match_ignore_case(cstr a, cstr b);
+int cstr_compare(cstr a, cstr b);
+bool cstr_starts_with(cstr input, cstr prefix);
+bool cstr_ends_with(cstr input, cstr suffix);
 bool cstr_contains(cstr haystack, cstr needle);
 cstr cstr_find_first(cstr haystack, cstr needle);
+cstr cstr_find_first_kmp(cstr haystack, cstr needle);
+cstr_pattern cstr_pattern_compile(cstr needle);
+cstr cstr_pattern_find_first(const cstr_pattern *pattern, cstr haystack);
+bool cstr_pattern_contains(const cstr_pattern *pattern, cstr haystack);
+size_t cstr_pattern_find_all(const cstr_pattern *pattern, cstr haystack,
+                             cstr *matches, size_t max_matches);
+size_t cstr_pattern_count(const cstr_pattern *pattern, cstr haystack);
+cstr cstr_pattern_find_first_parallel(const cstr_pattern *pattern, cstr haystack,
+                                      size_t thread_count);
+size_t cstr_pattern_find_all_parallel(const cstr_pattern *pattern, cstr haystack,
+                                      size_t thread_count, cstr *matches, size_t max_matches);
+size_t cstr_pattern_count_parallel(const cstr_pattern *pattern, cstr haystack,
+                                   size_t thread_count);
+cstr_multi_pattern cstr_multi_pattern_compile(const cstr *needles, size_t needle_count,
+                                              allocator alloc);
+bool cstr_multi_pattern_find_first(const cstr_multi_pattern *pattern, cstr haystack,
+                                   cstr_multi_match *match);
+size_t cstr_multi_pattern_find_all(const cstr_multi_pattern *pattern, cstr haystack,
+                                   cstr_multi_match *matches, size_t max_matches);
+bool cstr_multi_pattern_contains(const cstr_multi_pattern *pattern, cstr haystack);
+void cstr_multi_pattern_free(cstr_multi_pattern pattern);
+void cstr_arena_init(cstr_arena *arena, size_t block_size);
+allocator cstr_arena_allocator(cstr_arena *arena);
+void cstr_arena_reset(cstr_arena *arena);
+void cstr_arena_free(cstr_arena *arena);
+void *cstr_pool_run(void *context, void *ptr_to_free, size_t size);
+cstr_pool_stats cstr_pool_get_stats(void);
+void cstr_pool_trim(void);
+cstr_split cstr_split_on_byte(cstr input, char sep);
+cstr_split cstr_split_on(cstr input, cstr sep);
+cstr_split cstr_split_on_any(cstr input, cstr set);
+bool cstr_split_next(cstr_split *split, cstr *token);
+cstr cstr_split_remaining(const cstr_split *split);
+uint64_t cstr_hash(cstr input);
+uint64_t cstr_hash_seeded(cstr input, uint64_t seed);
+cstr_map cstr_map_new(allocator alloc);
+bool cstr_map_insert(cstr_map *map, cstr key, void *value);
+void **cstr_map_get(const cstr_map *map, cstr key);
+void **cstr_map_get_hashed(const cstr_map *map, cstr key, uint64_t hash);
+bool cstr_map_remove(cstr_map *map, cstr key);
+void cstr_map_free(cstr_map map);
+void cstr_interner_init(cstr_interner *interner);
+cstr cstr_intern(cstr_interner *interner, cstr input);
+size_t cstr_intern_id(cstr_interner *interner, cstr input);
+cstr cstr_interner_lookup(cstr_interner *interner, size_t id);
+cstr_interner_stats cstr_interner_get_stats(cstr_interner *interner);
+void cstr_interner_free(cstr_interner *interner);
+cstr_rope cstr_rope_new(allocator alloc);
+void cstr_rope_append_impl(cstr_rope *rope, cstr input);
+void cstr_rope_append_ref(cstr_rope *rope, cstr input);
+bool cstr_rope_write(const cstr_rope *rope, int fd);
+cstring cstr_rope_flatten(const cstr_rope *rope, allocator alloc);
+void cstr_rope_free(cstr_rope rope);
+bool cstr_mmap_file(const char *path, cstr_mmap_advice advice, cstr_file_mapping *mapping);
+void cstr_munmap_file(cstr_file_mapping mapping);
+cstr_reader cstr_reader_new(int fd, char delimiter, allocator alloc);
+bool cstr_reader_next(cstr_reader *reader, cstr *record);
+void cstr_reader_free(cstr_reader reader);
 cstring c_string_from_cstr(cstr input, allocator alloc);
 void cstring_append_impl(cstring *, cstr);
+char *cstring_grow(cstring *string, size_t additional);
+void cstring_reserve(cstring *string, size_t capacity);
+void cstring_shrink_to_fit(cstring *string);
+void cstring_clear(cstring *string);
+void cstring_assign_impl(cstring *string, cstr input);
 void cstring_free(cstring string);
+bool cstr_parse_u64(cstr input, uint64_t *value);
+bool cstr_parse_i64(cstr input, int64_t *value);
+bool cstr_parse_f64(cstr input, double *value);
+void cstring_append_u64(cstring *string, uint64_t value);
+void cstring_append_i64(cstring *string, int64_t value);
+void cstring_append_f64(cstring *string, double value);
+cstr cstr_trim_start(cstr input);
+cstr cstr_trim_end(cstr input);
+cstr cstr_trim(cstr input);
+void cstring_append_ascii_lower_impl(cstring *string, cstr input);
+void cstring_append_ascii_upper_impl(cstring *string, cstr input);
+void cstring_replace_all_impl(cstring *string, cstr needle, cstr replacement);
+cstring cstring_join_impl(const cstr *pieces, size_t count, cstr separator, allocator alloc);
+cstring cstring_concat_impl(const cstr *pieces, size_t count, allocator alloc);
+bool cstr_is_ascii(cstr input);
+bool cstr_utf8_validate(cstr input);
+size_t cstr_utf8_length(cstr input);
+cstr_utf8_iter cstr_utf8_iter_new(cstr input);
+bool cstr_utf8_next(cstr_utf8_iter *iter, uint32_t *code_point);
 
 #ifndef __cplusplus
 
@@ -60,7 +437,14 @@ cstr cstr_(const char *input)
     return cstr_from_char_ptr(input);
 }
 cstr cstr_(cstring input) { return cstr_from_cstring(input); }
-cstr cstr_(cstr input) { return input; }
+constexpr cstr cstr_(cstr input) { return input; }
+
+#ifdef CSTR_STRING_VIEW
+constexpr cstr cstr_(std::string_view input)
+{
+    return cstr{input.size(), input.data()};
+}
+#endif
 
 #endif
 
@@ -79,14 +463,19 @@ cstr cstr_(cstr input) { return input; }
 
 #ifndef __cplusplus
 
-#define TAKE_TIL_SEP(sep, begin, end) \
-    _Generic((sep), char *            \
-             : take_til_sep_char_ptr)(sep, begin, end)
+#define TAKE_TIL_SEP(sep, begin, end)                    \
+    _Generic((sep), char *                               \
+             : take_til_sep_char_ptr, const char *       \
+             : take_til_sep_char_ptr, cstr               \
+             : take_til_sep_cstr, cstr_pattern *         \
+             : take_til_sep_pattern, const cstr_pattern * \
+             : take_til_sep_pattern)(sep, begin, end)
 
 #else
 
 cstr take_til_sep_char_ptr(const char *, const char *, const char *);
 cstr take_til_sep_cstr(cstr, const char *, const char *);
+cstr take_til_sep_pattern(const cstr_pattern *, const char *, const char *);
 
 cstr take_til_sep(const char *sep, const char *begin, const char *end)
 {
@@ -98,6 +487,11 @@ cstr take_til_sep(cstr sep, const char *begin, const char *end)
     return take_til_sep_cstr(sep, begin, end);
 }
 
+cstr take_til_sep(const cstr_pattern *sep, const char *begin, const char *end)
+{
+    return take_til_sep_pattern(sep, begin, end);
+}
+
 #define TAKE_TIL_SEP(sep, begin, end) take_til_sep(sep, begin, end)
 
 #endif
@@ -107,13 +501,13 @@ cstr take_til_sep(cstr sep, const char *begin, const char *end)
 
 #define UNIQUE_NAME(base) CONCAT(base, __LINE__)
 
-#define FOR_ITER_CSTR(it, input, sep)                              \
-    const char *UNIQUE_NAME(end) = end(cstr(input));               \
-    const size_t UNIQUE_NAME(sep_len) = len(cstr(sep));            \
-    for (                                                          \
-        cstr it = TAKE_TIL_SEP(sep, ptr(input), UNIQUE_NAME(end)); \
-        ptr(it) < UNIQUE_NAME(end);                                \
-        it = TAKE_TIL_SEP(sep, end(it) + UNIQUE_NAME(sep_len), UNIQUE_NAME(end)))
+#define FOR_ITER_CSTR(it, input, sep)                                                    \
+    const char *UNIQUE_NAME(end) = end(cstr(input));                                     \
+    const cstr_pattern UNIQUE_NAME(sep_pattern) = cstr_pattern_compile(cstr(sep));       \
+    for (                                                                                \
+        cstr it = TAKE_TIL_SEP(&UNIQUE_NAME(sep_pattern), ptr(input), UNIQUE_NAME(end)); \
+        ptr(it) < UNIQUE_NAME(end);                                                      \
+        it = TAKE_TIL_SEP(&UNIQUE_NAME(sep_pattern), end(it) + len(UNIQUE_NAME(sep_pattern).needle), UNIQUE_NAME(end)))
 
 cstr take_til_sep_cstr(cstr sep, const char *begin, const char *end)
 {
@@ -129,6 +523,20 @@ cstr take_til_sep_cstr(cstr sep, const char *begin, const char *end)
     return (cstr){.length = (size_t)(ptr(found_sep) - begin), .inner = begin};
 }
 
+cstr take_til_sep_pattern(const cstr_pattern *sep, const char *begin, const char *end)
+{
+    if (begin >= end)
+        return (cstr){.length = 0, .inner = end};
+
+    cstr str_begin = (cstr){
+        .length = (size_t)(end - begin),
+        .inner = begin,
+    };
+    cstr found_sep = cstr_pattern_find_first(sep, str_begin);
+
+    return (cstr){.length = (size_t)(ptr(found_sep) - begin), .inner = begin};
+}
+
 cstr take_til_sep_char_ptr(const char *sep, const char *begin, const char *end)
 {
     return take_til_sep_cstr(cstr(sep), begin, end);
@@ -151,8 +559,11 @@ cstr cstr_from_cstring(cstring input)
 
 cstring c_string_from_cstr(cstr input, allocator alloc)
 {
-    char *buffer = (char *)alloc.run(NULL, input.length);
-    memcpy(buffer, input.inner, input.length);
+    char *buffer = (char *)alloc.run(alloc.context, NULL, input.length);
+
+    /* empty strings get no buffer at all */
+    if (input.length != 0)
+        memcpy(buffer, input.inner, input.length);
 
     return (cstring){
         .length = input.length,
@@ -164,35 +575,279 @@ cstring c_string_from_cstr(cstr input, allocator alloc)
 
 void cstring_free(cstring string)
 {
-    string.alloc.run(string.inner, 0);
+    string.alloc.run(string.alloc.context, string.inner, 0);
 }
 
 #define cstring_append(x, y) cstring_append_impl(x, cstr(y))
 
-void cstring_append_impl(cstring *fst, cstr snd)
+#define CSTRING_MIN_CAPACITY 16
+
+/*
+ * Makes room for additional bytes behind the current contents and returns
+ * where they go. The length is left unchanged, callers write the bytes and
+ * add them to the length themselves.
+ */
+char *cstring_grow(cstring *string, size_t additional)
 {
-    if (fst->capacity < fst->length + snd.length)
+    if (string->capacity < string->length + additional)
     {
-        fst->inner = (char *)fst->alloc.run(fst->inner, fst->length + snd.length);
-        fst->capacity = fst->length + snd.length;
+        /* grow geometrically, so repeated appends are amortized O(1) */
+        size_t capacity = 2 * string->capacity;
+
+        if (capacity < CSTRING_MIN_CAPACITY)
+            capacity = CSTRING_MIN_CAPACITY;
+        if (capacity < string->length + additional)
+            capacity = string->length + additional;
+
+        cstring_reserve(string, capacity);
     }
 
-    memcpy(&fst->inner[fst->length], snd.inner, snd.length);
+    return &string->inner[string->length];
+}
+
+void cstring_append_impl(cstring *fst, cstr snd)
+{
+    /* an empty string may have no buffer yet, and memcpy must not see NULL */
+    if (snd.length == 0)
+        return;
+
+    memcpy(cstring_grow(fst, snd.length), snd.inner, snd.length);
     fst->length += snd.length;
 }
 
+void cstring_reserve(cstring *string, size_t capacity)
+{
+    if (string->capacity >= capacity)
+        return;
+
+    string->inner = (char *)string->alloc.run(string->alloc.context, string->inner, capacity);
+    string->capacity = capacity;
+}
+
+void cstring_shrink_to_fit(cstring *string)
+{
+    if (string->capacity == string->length)
+        return;
+
+    if (string->length == 0)
+    {
+        string->alloc.run(string->alloc.context, string->inner, 0);
+        string->inner = NULL;
+    }
+    else
+        string->inner = (char *)string->alloc.run(string->alloc.context, string->inner, string->length);
+
+    string->capacity = string->length;
+}
+
+/* empties the string, but keeps its buffer for reuse */
+void cstring_clear(cstring *string)
+{
+    string->length = 0;
+}
+
+#define cstring_assign(x, y) cstring_assign_impl(x, cstr(y))
+
+/*
+ * Replaces the contents, reusing the buffer. A tokenizer that copies each
+ * token into the same cstring only allocates when a token outgrows all
+ * earlier ones. input must not point into the string.
+ */
+void cstring_assign_impl(cstring *string, cstr input)
+{
+    string->length = 0;
+    cstring_append_impl(string, input);
+}
+
+/* index of the first differing byte within length bytes of the words */
+size_t cstr_word_mismatch(unsigned long long a, unsigned long long b, size_t length)
+{
+    unsigned long long diff = a ^ b;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (diff != 0)
+        return (size_t)__builtin_ctzll(diff) / 8;
+#else
+    for (size_t i = 0; diff != 0 && i < length; i++)
+        if (((const char *)&a)[i] != ((const char *)&b)[i])
+            return i;
+#endif
+
+    return length;
+}
+
+#define CSTR_ASCII_LOWER(c) ((c) >= 'A' && (c) <= 'Z' ? (c) + ('a' - 'A') : (c))
+
+size_t cstr_mismatch_scalar(const char *a, const char *b, size_t length, size_t i)
+{
+    for (; i + 8 <= length; i += 8)
+    {
+        unsigned long long word_a, word_b;
+        memcpy(&word_a, a + i, 8);
+        memcpy(&word_b, b + i, 8);
+
+        if (word_a != word_b)
+            return i + cstr_word_mismatch(word_a, word_b, 8);
+    }
+
+    for (; i < length; i++)
+        if (a[i] != b[i])
+            return i;
+
+    return length;
+}
+
+size_t cstr_mismatch_ignore_case_scalar(const char *a, const char *b, size_t length, size_t i)
+{
+    for (; i < length; i++)
+        if (CSTR_ASCII_LOWER(a[i]) != CSTR_ASCII_LOWER(b[i]))
+            return i;
+
+    return length;
+}
+
+#ifdef CSTR_X86_SIMD
+
+__attribute__((target("sse2")))
+size_t cstr_mismatch_sse2(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i block_a = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i block_b = _mm_loadu_si128((const __m128i *)(b + i));
+        unsigned equal = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block_a, block_b));
+
+        if (equal != 0xFFFF)
+            return i + __builtin_ctz(~equal);
+    }
+
+    return cstr_mismatch_scalar(a, b, length, i);
+}
+
+__attribute__((target("avx2")))
+size_t cstr_mismatch_avx2(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 64 <= length; i += 64)
+    {
+        __m256i diff_low = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                            _mm256_loadu_si256((const __m256i *)(b + i)));
+        __m256i diff_high = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 32)),
+                                             _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+        __m256i diff = _mm256_or_si256(diff_low, diff_high);
+
+        if (!_mm256_testz_si256(diff, diff))
+            break;
+    }
+
+    for (; i + 32 <= length; i += 32)
+    {
+        unsigned equal = (unsigned)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                              _mm256_loadu_si256((const __m256i *)(b + i))));
+
+        if (equal != 0xFFFFFFFFu)
+            return i + __builtin_ctz(~equal);
+    }
+
+    return cstr_mismatch_sse2(a + i, b + i, length - i) + i;
+}
+
+/* sets the 0x20 bit of every byte in A-Z */
+__attribute__((target("sse2")))
+__m128i cstr_ascii_lower_sse2(__m128i block)
+{
+    __m128i shifted = _mm_sub_epi8(block, _mm_set1_epi8((char)('A' + 128)));
+    __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + 26)));
+
+    return _mm_or_si128(block, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("sse2")))
+size_t cstr_mismatch_ignore_case_sse2(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i block_a = cstr_ascii_lower_sse2(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m128i block_b = cstr_ascii_lower_sse2(_mm_loadu_si128((const __m128i *)(b + i)));
+        unsigned equal = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block_a, block_b));
+
+        if (equal != 0xFFFF)
+            return i + __builtin_ctz(~equal);
+    }
+
+    return cstr_mismatch_ignore_case_scalar(a, b, length, i);
+}
+
+#endif
+
+/* index of the first differing byte of a and b, or length if there is none */
+size_t cstr_mismatch(const char *a, const char *b, size_t length)
+{
+#ifdef CSTR_X86_SIMD
+    if (length >= 64 && __builtin_cpu_supports("avx2"))
+        return cstr_mismatch_avx2(a, b, length);
+    if (length >= 16 && __builtin_cpu_supports("sse2"))
+        return cstr_mismatch_sse2(a, b, length);
+#endif
+
+    return cstr_mismatch_scalar(a, b, length, 0);
+}
+
+/* like cstr_mismatch, but ignoring ASCII case */
+size_t cstr_mismatch_ignore_case(const char *a, const char *b, size_t length)
+{
+#ifdef CSTR_X86_SIMD
+    if (length >= 16 && __builtin_cpu_supports("sse2"))
+        return cstr_mismatch_ignore_case_sse2(a, b, length);
+#endif
+
+    return cstr_mismatch_ignore_case_scalar(a, b, length, 0);
+}
+
 bool cstr_match(cstr a, cstr b)
 {
     if (a.length != b.length)
         return false;
 
-    const char *end = a.inner + a.length;
+    return cstr_mismatch(a.inner, b.inner, a.length) == a.length;
+}
 
-    while (a.inner < end)
-        if (*a.inner++ != *b.inner++)
-            return false;
+bool cstr_match_ignore_case(cstr a, cstr b)
+{
+    if (a.length != b.length)
+        return false;
 
-    return true;
+    return cstr_mismatch_ignore_case(a.inner, b.inner, a.length) == a.length;
+}
+
+/* lexicographic order of the unsigned bytes, negative if a comes first */
+int cstr_compare(cstr a, cstr b)
+{
+    const size_t length = len(a) < len(b) ? len(a) : len(b);
+    const size_t i = cstr_mismatch(a.inner, b.inner, length);
+
+    if (i < length)
+        return (unsigned char)a.inner[i] < (unsigned char)b.inner[i] ? -1 : 1;
+
+    return len(a) < len(b) ? -1 : len(a) > len(b);
+}
+
+bool cstr_starts_with(cstr input, cstr prefix)
+{
+    return len(input) >= len(prefix) &&
+           cstr_mismatch(input.inner, prefix.inner, len(prefix)) == len(prefix);
+}
+
+bool cstr_ends_with(cstr input, cstr suffix)
+{
+    return len(input) >= len(suffix) &&
+           cstr_mismatch(end(input) - len(suffix), suffix.inner, len(suffix)) == len(suffix);
 }
 
 bool cstr_contains(cstr haystack, cstr needle)
@@ -203,7 +858,88 @@ bool cstr_contains(cstr haystack, cstr needle)
     return len(cstr_find_first(haystack, needle)) != 0;
 }
 
+#ifdef CSTR_X86_SIMD
+
+/*
+ * Candidate filtering: compare the first and the last byte of the needle
+ * against a whole vector of haystack positions at once and only verify the
+ * positions where both match. If verification keeps failing (e.g. on highly
+ * repetitive input), hand the rest over to KMP to stay linear.
+ */
+#define CSTR_FIND_FIRST_VECTORIZED(vec, width, set1, load, cmpeq, and_, movemask) \
+    const size_t last = len(needle) - 1;                                          \
+    const vec first_byte = set1(needle.inner[0]);                                 \
+    const vec last_byte = set1(needle.inner[last]);                               \
+    size_t verified = 0;                                                          \
+    size_t i = 0;                                                                 \
+                                                                                  \
+    for (; i + last + width <= len(haystack); i += width)                         \
+    {                                                                             \
+        vec block_first = load((const vec *)(haystack.inner + i));                \
+        vec block_last = load((const vec *)(haystack.inner + i + last));          \
+        unsigned mask = (unsigned)movemask(                                       \
+            and_(cmpeq(first_byte, block_first), cmpeq(last_byte, block_last)));  \
+                                                                                  \
+        while (mask != 0)                                                         \
+        {                                                                         \
+            const char *candidate = haystack.inner + i + __builtin_ctz(mask);     \
+            if (memcmp(candidate + 1, needle.inner + 1, last - 1) == 0)           \
+                return (cstr){.length = len(needle), .inner = candidate};         \
+                                                                                  \
+            verified += last;                                                     \
+            mask &= mask - 1;                                                     \
+        }                                                                         \
+                                                                                  \
+        if (verified > 2 * i + 1024)                                              \
+            return cstr_find_first_kmp(                                           \
+                (cstr){.length = len(haystack) - i, .inner = haystack.inner + i}, \
+                needle);                                                          \
+    }                                                                             \
+                                                                                  \
+    for (; i + last < len(haystack); i++)                                         \
+        if (memcmp(haystack.inner + i, needle.inner, len(needle)) == 0)           \
+            return (cstr){.length = len(needle), .inner = haystack.inner + i};    \
+                                                                                  \
+    return cstr_end(haystack);
+
+__attribute__((target("sse2")))
+cstr cstr_find_first_sse2(cstr haystack, cstr needle)
+{
+    CSTR_FIND_FIRST_VECTORIZED(__m128i, 16, _mm_set1_epi8, _mm_loadu_si128,
+                               _mm_cmpeq_epi8, _mm_and_si128, _mm_movemask_epi8)
+}
+
+__attribute__((target("avx2")))
+cstr cstr_find_first_avx2(cstr haystack, cstr needle)
+{
+    CSTR_FIND_FIRST_VECTORIZED(__m256i, 32, _mm256_set1_epi8, _mm256_loadu_si256,
+                               _mm256_cmpeq_epi8, _mm256_and_si256, _mm256_movemask_epi8)
+}
+
+#endif
+
 cstr cstr_find_first(cstr haystack, cstr needle)
+{
+    if (len(needle) == 0 || len(needle) > len(haystack))
+        return cstr_end(haystack);
+
+    if (len(needle) == 1)
+    {
+        const char *found = (const char *)memchr(ptr(haystack), *ptr(needle), len(haystack));
+        return found == NULL ? cstr_end(haystack) : (cstr){.length = 1, .inner = found};
+    }
+
+#ifdef CSTR_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return cstr_find_first_avx2(haystack, needle);
+    if (__builtin_cpu_supports("sse2"))
+        return cstr_find_first_sse2(haystack, needle);
+#endif
+
+    return cstr_find_first_kmp(haystack, needle);
+}
+
+cstr cstr_find_first_kmp(cstr haystack, cstr needle)
 {
     if (len(needle) == 0)
         return cstr_end(haystack);
@@ -212,7 +948,7 @@ cstr cstr_find_first(cstr haystack, cstr needle)
     int shift_table[needle.length];
     shift_table[0] = -1;
 
-    while (++right < needle.length)
+    while ((size_t)++right < needle.length)
     {
         if (needle.inner[left] == needle.inner[right])
             shift_table[right] = shift_table[left];
@@ -235,11 +971,3435 @@ cstr cstr_find_first(cstr haystack, cstr needle)
         needle_pos++;
         inc(haystack);
 
-        if (needle_pos == len(needle))
+        if ((size_t)needle_pos == len(needle))
             return (cstr){
                 .length = len(needle),
                 .inner = haystack.inner - len(needle)};
     }
 
     return cstr_end(haystack);
-}
\ No newline at end of file
+}
+
+cstr_pattern cstr_pattern_compile(cstr needle)
+{
+    cstr_pattern pattern;
+    pattern.needle = needle;
+
+    if (len(needle) == 0)
+        pattern.kind = cstr_search_empty;
+    else if (len(needle) == 1)
+        pattern.kind = cstr_search_byte;
+#ifdef CSTR_X86_SIMD
+    else if (__builtin_cpu_supports("avx2"))
+        pattern.kind = cstr_search_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        pattern.kind = cstr_search_sse2;
+#endif
+    else
+        pattern.kind = cstr_search_horspool;
+
+    for (size_t i = 0; i < 256; i++)
+        pattern.shift[i] = len(needle);
+
+    for (size_t i = 0; i + 1 < len(needle); i++)
+        pattern.shift[(unsigned char)needle.inner[i]] = len(needle) - 1 - i;
+
+    return pattern;
+}
+
+cstr cstr_find_first_horspool(const cstr_pattern *pattern, cstr haystack)
+{
+    const cstr needle = pattern->needle;
+    const size_t last = len(needle) - 1;
+    size_t i = 0;
+
+    while (i + last < len(haystack))
+    {
+        unsigned char c = (unsigned char)haystack.inner[i + last];
+
+        if (c == (unsigned char)needle.inner[last] &&
+            memcmp(haystack.inner + i, needle.inner, last) == 0)
+            return (cstr){.length = len(needle), .inner = haystack.inner + i};
+
+        i += pattern->shift[c];
+    }
+
+    return cstr_end(haystack);
+}
+
+cstr cstr_pattern_find_first(const cstr_pattern *pattern, cstr haystack)
+{
+    if (len(pattern->needle) > len(haystack))
+        return cstr_end(haystack);
+
+    switch (pattern->kind)
+    {
+    case cstr_search_empty:
+        return cstr_end(haystack);
+
+    case cstr_search_byte:
+    {
+        const char *found = (const char *)memchr(ptr(haystack), *ptr(pattern->needle), len(haystack));
+        return found == NULL ? cstr_end(haystack) : (cstr){.length = 1, .inner = found};
+    }
+
+#ifdef CSTR_X86_SIMD
+    case cstr_search_sse2:
+        return cstr_find_first_sse2(haystack, pattern->needle);
+
+    case cstr_search_avx2:
+        return cstr_find_first_avx2(haystack, pattern->needle);
+#endif
+
+    default:
+        return cstr_find_first_horspool(pattern, haystack);
+    }
+}
+
+bool cstr_pattern_contains(const cstr_pattern *pattern, cstr haystack)
+{
+    if (len(pattern->needle) == 0)
+        return true;
+
+    return len(cstr_pattern_find_first(pattern, haystack)) != 0;
+}
+
+/*
+ * Stores up to max_matches non-overlapping matches, scanning left to right,
+ * and returns the total number of matches (which may exceed max_matches).
+ */
+size_t cstr_pattern_find_all(const cstr_pattern *pattern, cstr haystack,
+                             cstr *matches, size_t max_matches)
+{
+    size_t count = 0;
+
+    if (len(pattern->needle) == 0)
+        return 0;
+
+    while (true)
+    {
+        cstr found = cstr_pattern_find_first(pattern, haystack);
+        if (len(found) == 0)
+            return count;
+
+        if (count < max_matches)
+            matches[count] = found;
+        count++;
+
+        haystack = (cstr){.length = (size_t)(end(haystack) - end(found)), .inner = end(found)};
+    }
+}
+
+size_t cstr_count_byte_scalar(const char *input, size_t length, size_t i, char byte)
+{
+    size_t count = 0;
+
+    for (; i < length; i++)
+        count += input[i] == byte;
+
+    return count;
+}
+
+#ifdef CSTR_X86_SIMD
+
+__attribute__((target("sse2")))
+size_t cstr_count_byte_sse2(const char *input, size_t length, char byte)
+{
+    const __m128i needle = _mm_set1_epi8(byte);
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(input + i));
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    }
+
+    return count + cstr_count_byte_scalar(input, length, i, byte);
+}
+
+__attribute__((target("avx2")))
+size_t cstr_count_byte_avx2(const char *input, size_t length, char byte)
+{
+    const __m256i needle = _mm256_set1_epi8(byte);
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(input + i));
+        count += (size_t)__builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+    }
+
+    return count + cstr_count_byte_scalar(input, length, i, byte);
+}
+
+#endif
+
+size_t cstr_pattern_count(const cstr_pattern *pattern, cstr haystack)
+{
+    /* occurrences of a single byte never overlap, so all of them count */
+    if (pattern->kind == cstr_search_byte)
+    {
+        char byte = *ptr(pattern->needle);
+
+#ifdef CSTR_X86_SIMD
+        if (len(haystack) >= 32 && __builtin_cpu_supports("avx2"))
+            return cstr_count_byte_avx2(ptr(haystack), len(haystack), byte);
+        if (len(haystack) >= 16 && __builtin_cpu_supports("sse2"))
+            return cstr_count_byte_sse2(ptr(haystack), len(haystack), byte);
+#endif
+
+        return cstr_count_byte_scalar(ptr(haystack), len(haystack), 0, byte);
+    }
+
+    return cstr_pattern_find_all(pattern, haystack, NULL, 0);
+}
+
+#define CSTR_NO_OUTPUT ((size_t)-1)
+
+/*
+ * Builds the trie over byte classes (bytes that occur in no needle share
+ * class 0), then turns it into a full DFA in breadth first order, so the
+ * scan never follows failure links. Empty needles are ignored, duplicate
+ * needles each report their own match.
+ */
+cstr_multi_pattern cstr_multi_pattern_compile(const cstr *needles, size_t needle_count,
+                                              allocator alloc)
+{
+    cstr_multi_pattern pattern;
+    bool seen[256] = {false};
+    size_t max_states = 1;
+
+    memset(pattern.byte_class, 0, sizeof(pattern.byte_class));
+    pattern.class_count = 1;
+    pattern.needle_count = needle_count;
+    pattern.alloc = alloc;
+
+    for (size_t n = 0; n < needle_count; n++)
+    {
+        max_states += len(needles[n]);
+
+        for (size_t i = 0; i < len(needles[n]); i++)
+        {
+            unsigned char c = (unsigned char)needles[n].inner[i];
+            if (seen[c])
+                continue;
+
+            /* with all 256 bytes in use, class 0 is free for the last one */
+            seen[c] = true;
+            if (pattern.class_count < 256)
+                pattern.byte_class[c] = (unsigned char)pattern.class_count++;
+        }
+    }
+
+    const size_t classes = pattern.class_count;
+    char *memory = (char *)alloc.run(alloc.context, NULL,
+                                     2 * needle_count * sizeof(size_t) +
+                                         max_states * sizeof(size_t) +
+                                         max_states * sizeof(unsigned) +
+                                         max_states * classes * sizeof(unsigned));
+
+    pattern.needle_lengths = (size_t *)memory;
+    pattern.needle_duplicate = pattern.needle_lengths + needle_count;
+    pattern.output = pattern.needle_duplicate + needle_count;
+    pattern.output_link = (unsigned *)(pattern.output + max_states);
+    pattern.transitions = pattern.output_link + max_states;
+
+    memset(pattern.transitions, 0, max_states * classes * sizeof(unsigned));
+    memset(pattern.output_link, 0, max_states * sizeof(unsigned));
+    for (size_t state = 0; state < max_states; state++)
+        pattern.output[state] = CSTR_NO_OUTPUT;
+
+    pattern.state_count = 1;
+
+    for (size_t n = 0; n < needle_count; n++)
+    {
+        unsigned state = 0;
+        pattern.needle_lengths[n] = len(needles[n]);
+        pattern.needle_duplicate[n] = CSTR_NO_OUTPUT;
+
+        if (len(needles[n]) == 0)
+            continue;
+
+        for (size_t i = 0; i < len(needles[n]); i++)
+        {
+            unsigned *next = &pattern.transitions[state * classes +
+                                                  pattern.byte_class[(unsigned char)needles[n].inner[i]]];
+            if (*next == 0)
+                *next = (unsigned)pattern.state_count++;
+            state = *next;
+        }
+
+        size_t *last = &pattern.output[state];
+        while (*last != CSTR_NO_OUTPUT)
+            last = &pattern.needle_duplicate[*last];
+        *last = n;
+    }
+
+    unsigned *fail = (unsigned *)alloc.run(alloc.context, NULL, 2 * pattern.state_count * sizeof(unsigned));
+    unsigned *queue = fail + pattern.state_count;
+    size_t queue_begin = 0, queue_end = 0;
+
+    for (size_t c = 0; c < classes; c++)
+    {
+        unsigned child = pattern.transitions[c];
+        if (child != 0)
+        {
+            fail[child] = 0;
+            queue[queue_end++] = child;
+        }
+    }
+
+    while (queue_begin < queue_end)
+    {
+        unsigned state = queue[queue_begin++];
+        unsigned *row = &pattern.transitions[state * classes];
+        const unsigned *fail_row = &pattern.transitions[fail[state] * classes];
+
+        for (size_t c = 0; c < classes; c++)
+        {
+            if (row[c] == 0)
+            {
+                row[c] = fail_row[c];
+                continue;
+            }
+
+            unsigned child = row[c];
+            unsigned child_fail = fail_row[c];
+
+            fail[child] = child_fail;
+            pattern.output_link[child] = pattern.output[child_fail] != CSTR_NO_OUTPUT
+                                             ? child_fail
+                                             : pattern.output_link[child_fail];
+            queue[queue_end++] = child;
+        }
+    }
+
+    alloc.run(alloc.context, fail, 0);
+
+    return pattern;
+}
+
+/*
+ * Runs the automaton and evaluates report for every match, ordered by end
+ * position and, for the same end position, from the longest needle to the
+ * shortest (duplicates by index).
+ */
+#define CSTR_MULTI_PATTERN_SCAN(pattern, haystack, report)                              \
+    do                                                                                \
+    {                                                                                 \
+        const size_t __classes = (pattern)->class_count;                              \
+        unsigned __state = 0;                                                         \
+                                                                                      \
+        for (size_t __i = 0; __i < len(haystack); __i++)                              \
+        {                                                                             \
+            unsigned char __c = (unsigned char)(haystack).inner[__i];                 \
+            __state = (pattern)->transitions[__state * __classes +                    \
+                                             (pattern)->byte_class[__c]];             \
+                                                                                      \
+            unsigned __out = (pattern)->output[__state] != CSTR_NO_OUTPUT             \
+                                 ? __state                                            \
+                                 : (pattern)->output_link[__state];                   \
+                                                                                      \
+            for (; __out != 0; __out = (pattern)->output_link[__out])                 \
+                for (size_t __index = (pattern)->output[__out];                       \
+                     __index != CSTR_NO_OUTPUT;                                       \
+                     __index = (pattern)->needle_duplicate[__index])                  \
+                {                                                                     \
+                    cstr_multi_match __match = {                                      \
+                        __index, __i + 1 - (pattern)->needle_lengths[__index]};       \
+                    report;                                                           \
+                }                                                                     \
+        }                                                                             \
+    } while (false)
+
+bool cstr_multi_pattern_find_first(const cstr_multi_pattern *pattern, cstr haystack,
+                                   cstr_multi_match *match)
+{
+    CSTR_MULTI_PATTERN_SCAN(pattern, haystack, {
+        if (match != NULL)
+            *match = __match;
+        return true;
+    });
+
+    return false;
+}
+
+/*
+ * Stores up to max_matches matches, including overlapping ones, and returns
+ * the total number of matches (which may exceed max_matches).
+ */
+size_t cstr_multi_pattern_find_all(const cstr_multi_pattern *pattern, cstr haystack,
+                                   cstr_multi_match *matches, size_t max_matches)
+{
+    size_t count = 0;
+
+    CSTR_MULTI_PATTERN_SCAN(pattern, haystack, {
+        if (count < max_matches)
+            matches[count] = __match;
+        count++;
+    });
+
+    return count;
+}
+
+bool cstr_multi_pattern_contains(const cstr_multi_pattern *pattern, cstr haystack)
+{
+    return cstr_multi_pattern_find_first(pattern, haystack, NULL);
+}
+
+void cstr_multi_pattern_free(cstr_multi_pattern pattern)
+{
+    pattern.alloc.run(pattern.alloc.context, pattern.needle_lengths, 0);
+}
+
+/*
+ * Every arena allocation is preceded by a header holding its size, so the
+ * allocator can copy on growth. The header also keeps allocations aligned.
+ */
+#define CSTR_ARENA_ALIGN 16
+#define CSTR_ARENA_ROUND(size) (((size) + CSTR_ARENA_ALIGN - 1) & ~(size_t)(CSTR_ARENA_ALIGN - 1))
+#define CSTR_ARENA_HEADER CSTR_ARENA_ROUND(sizeof(size_t))
+#define CSTR_ARENA_DATA(block) ((char *)(block) + CSTR_ARENA_ROUND(sizeof(cstr_arena_block)))
+#define CSTR_ARENA_SIZE(allocation) (*(size_t *)((allocation) - CSTR_ARENA_HEADER))
+
+void cstr_arena_init(cstr_arena *arena, size_t block_size)
+{
+    arena->blocks = NULL;
+    arena->block_size = block_size;
+    arena->last = NULL;
+}
+
+cstr_arena_block *cstr_arena_add_block(cstr_arena *arena, size_t capacity)
+{
+    if (capacity < arena->block_size)
+        capacity = arena->block_size;
+
+    cstr_arena_block *block = (cstr_arena_block *)malloc(
+        CSTR_ARENA_ROUND(sizeof(cstr_arena_block)) + capacity);
+    block->next = arena->blocks;
+    block->capacity = capacity;
+    block->used = 0;
+    arena->blocks = block;
+
+    return block;
+}
+
+char *cstr_arena_bump(cstr_arena *arena, size_t size)
+{
+    const size_t needed = CSTR_ARENA_HEADER + CSTR_ARENA_ROUND(size);
+    cstr_arena_block *block = arena->blocks;
+
+    if (block == NULL || block->capacity - block->used < needed)
+        block = cstr_arena_add_block(arena, needed);
+
+    char *allocation = CSTR_ARENA_DATA(block) + block->used + CSTR_ARENA_HEADER;
+    block->used += needed;
+    CSTR_ARENA_SIZE(allocation) = size;
+    arena->last = allocation;
+
+    return allocation;
+}
+
+/* realloc-shaped entry point of the arena allocator */
+void *cstr_arena_run(void *context, void *ptr_to_free, size_t size)
+{
+    cstr_arena *arena = (cstr_arena *)context;
+    char *allocation = (char *)ptr_to_free;
+
+    if (allocation == NULL)
+        return size == 0 ? NULL : cstr_arena_bump(arena, size);
+
+    /* the most recent allocation can be released, grown or shrunk in place */
+    if (allocation == arena->last)
+    {
+        cstr_arena_block *block = arena->blocks;
+        const size_t offset = (size_t)(allocation - CSTR_ARENA_HEADER - CSTR_ARENA_DATA(block));
+
+        if (size == 0)
+        {
+            block->used = offset;
+            arena->last = NULL;
+            return NULL;
+        }
+
+        if (offset + CSTR_ARENA_HEADER + CSTR_ARENA_ROUND(size) <= block->capacity)
+        {
+            block->used = offset + CSTR_ARENA_HEADER + CSTR_ARENA_ROUND(size);
+            CSTR_ARENA_SIZE(allocation) = size;
+            return allocation;
+        }
+    }
+
+    if (size == 0)
+        return NULL;
+
+    if (size <= CSTR_ARENA_SIZE(allocation))
+    {
+        CSTR_ARENA_SIZE(allocation) = size;
+        return allocation;
+    }
+
+    char *moved = cstr_arena_bump(arena, size);
+    memcpy(moved, allocation, CSTR_ARENA_SIZE(allocation));
+
+    return moved;
+}
+
+allocator cstr_arena_allocator(cstr_arena *arena)
+{
+    return (allocator){.run = &cstr_arena_run, .context = arena};
+}
+
+/*
+ * Releases everything allocated from the arena. If the last round needed
+ * more than one block, they are merged into one big enough for all of it.
+ */
+void cstr_arena_reset(cstr_arena *arena)
+{
+    cstr_arena_block *block = arena->blocks;
+    arena->last = NULL;
+
+    if (block == NULL)
+        return;
+
+    if (block->next == NULL)
+    {
+        block->used = 0;
+        return;
+    }
+
+    size_t capacity = 0;
+    for (; block != NULL; block = block->next)
+        capacity += block->capacity;
+
+    cstr_arena_free(arena);
+    cstr_arena_add_block(arena, capacity);
+}
+
+void cstr_arena_free(cstr_arena *arena)
+{
+    cstr_arena_block *block = arena->blocks;
+
+    while (block != NULL)
+    {
+        cstr_arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+    arena->last = NULL;
+}
+
+/*
+ * Each pool block starts with a header holding its size class, and for
+ * oversized blocks the requested size. Blocks are never given back to the
+ * system, but recycled through a free list per thread and size class.
+ * Threads exchange blocks with the global lists in batches, so the global
+ * lock is only taken on a cache miss or when a thread cache overflows.
+ */
+#define CSTR_POOL_HEADER 16
+#define CSTR_POOL_BATCH 32
+#define CSTR_POOL_CLASS_SIZE(class_index) ((size_t)1 << ((class_index) + CSTR_POOL_MIN_SHIFT))
+#define CSTR_POOL_CLASS_OF(block) (((size_t *)((char *)(block) - CSTR_POOL_HEADER))[0])
+#define CSTR_POOL_SIZE_OF(block) (((size_t *)((char *)(block) - CSTR_POOL_HEADER))[1])
+#define CSTR_POOL_NEXT(block) (*(void **)(block))
+
+/* statistics are only written by the owning thread, but may be read by any */
+#define CSTR_POOL_COUNT(cache, field) \
+    __atomic_store_n(&(cache)->stats.field, (cache)->stats.field + 1, __ATOMIC_RELAXED)
+
+size_t cstr_pool_class_index(size_t size)
+{
+    if (size <= CSTR_POOL_CLASS_SIZE(0))
+        return 0;
+
+    size_t class_index = 0;
+    for (size--; size >> (class_index + CSTR_POOL_MIN_SHIFT) != 0; class_index++)
+        ;
+
+    return class_index;
+}
+
+void cstr_pool_thread_exit(void *cache_ptr)
+{
+    cstr_pool_cache *cache = (cstr_pool_cache *)cache_ptr;
+
+    pthread_mutex_lock(&cstr_pool.lock);
+
+    for (size_t c = 0; c < CSTR_POOL_CLASSES; c++)
+        while (cache->free_list[c] != NULL)
+        {
+            void *block = cache->free_list[c];
+            cache->free_list[c] = CSTR_POOL_NEXT(block);
+            CSTR_POOL_NEXT(block) = cstr_pool.free_list[c];
+            cstr_pool.free_list[c] = block;
+            cstr_pool.free_count[c]++;
+        }
+
+    cstr_pool.retired_stats.hits += cache->stats.hits;
+    cstr_pool.retired_stats.misses += cache->stats.misses;
+    cstr_pool.retired_stats.oversized += cache->stats.oversized;
+
+    if (cache->prev != NULL)
+        cache->prev->next = cache->next;
+    else
+        cstr_pool.caches = cache->next;
+    if (cache->next != NULL)
+        cache->next->prev = cache->prev;
+
+    pthread_mutex_unlock(&cstr_pool.lock);
+
+    memset(cache, 0, sizeof(*cache));
+}
+
+void cstr_pool_create_key(void)
+{
+    pthread_key_create(&cstr_pool.thread_key, &cstr_pool_thread_exit);
+}
+
+cstr_pool_cache *cstr_pool_get_cache(void)
+{
+    cstr_pool_cache *cache = &cstr_pool_thread_cache;
+
+    if (!cache->registered)
+    {
+        pthread_once(&cstr_pool.once, &cstr_pool_create_key);
+        pthread_setspecific(cstr_pool.thread_key, cache);
+
+        pthread_mutex_lock(&cstr_pool.lock);
+        cache->registered = true;
+        cache->prev = NULL;
+        cache->next = cstr_pool.caches;
+        if (cache->next != NULL)
+            cache->next->prev = cache;
+        cstr_pool.caches = cache;
+        pthread_mutex_unlock(&cstr_pool.lock);
+    }
+
+    return cache;
+}
+
+void *cstr_pool_allocate(cstr_pool_cache *cache, size_t size)
+{
+    const size_t class_index = cstr_pool_class_index(size);
+
+    if (class_index >= CSTR_POOL_CLASSES)
+    {
+        CSTR_POOL_COUNT(cache, oversized);
+        char *block = (char *)malloc(CSTR_POOL_HEADER + size) + CSTR_POOL_HEADER;
+        CSTR_POOL_CLASS_OF(block) = class_index;
+        CSTR_POOL_SIZE_OF(block) = size;
+        return block;
+    }
+
+    if (cache->free_list[class_index] != NULL)
+        CSTR_POOL_COUNT(cache, hits);
+    else
+    {
+        CSTR_POOL_COUNT(cache, misses);
+
+        pthread_mutex_lock(&cstr_pool.lock);
+        for (size_t i = 0; i < CSTR_POOL_BATCH && cstr_pool.free_list[class_index] != NULL; i++)
+        {
+            void *block = cstr_pool.free_list[class_index];
+            cstr_pool.free_list[class_index] = CSTR_POOL_NEXT(block);
+            cstr_pool.free_count[class_index]--;
+            CSTR_POOL_NEXT(block) = cache->free_list[class_index];
+            cache->free_list[class_index] = block;
+            cache->free_count[class_index]++;
+        }
+        pthread_mutex_unlock(&cstr_pool.lock);
+
+        if (cache->free_list[class_index] == NULL)
+        {
+            char *block = (char *)malloc(CSTR_POOL_HEADER + CSTR_POOL_CLASS_SIZE(class_index)) + CSTR_POOL_HEADER;
+            CSTR_POOL_CLASS_OF(block) = class_index;
+            return block;
+        }
+    }
+
+    void *block = cache->free_list[class_index];
+    cache->free_list[class_index] = CSTR_POOL_NEXT(block);
+    cache->free_count[class_index]--;
+
+    return block;
+}
+
+void cstr_pool_release(cstr_pool_cache *cache, void *block)
+{
+    const size_t class_index = CSTR_POOL_CLASS_OF(block);
+
+    if (class_index >= CSTR_POOL_CLASSES)
+    {
+        free((char *)block - CSTR_POOL_HEADER);
+        return;
+    }
+
+    CSTR_POOL_NEXT(block) = cache->free_list[class_index];
+    cache->free_list[class_index] = block;
+
+    if (++cache->free_count[class_index] < 2 * CSTR_POOL_BATCH)
+        return;
+
+    /* hand a batch back, so blocks freed by one thread can be reused by others */
+    pthread_mutex_lock(&cstr_pool.lock);
+    for (size_t i = 0; i < CSTR_POOL_BATCH; i++)
+    {
+        void *returned = cache->free_list[class_index];
+        cache->free_list[class_index] = CSTR_POOL_NEXT(returned);
+        CSTR_POOL_NEXT(returned) = cstr_pool.free_list[class_index];
+        cstr_pool.free_list[class_index] = returned;
+        cstr_pool.free_count[class_index]++;
+    }
+    cache->free_count[class_index] -= CSTR_POOL_BATCH;
+    pthread_mutex_unlock(&cstr_pool.lock);
+}
+
+/* realloc-shaped entry point of the pool allocator, the context is unused */
+void *cstr_pool_run(void *context, void *ptr_to_free, size_t size)
+{
+    (void)context;
+    cstr_pool_cache *cache = cstr_pool_get_cache();
+
+    if (ptr_to_free == NULL)
+        return size == 0 ? NULL : cstr_pool_allocate(cache, size);
+
+    if (size == 0)
+    {
+        cstr_pool_release(cache, ptr_to_free);
+        return NULL;
+    }
+
+    const size_t class_index = CSTR_POOL_CLASS_OF(ptr_to_free);
+    size_t old_size;
+
+    if (class_index < CSTR_POOL_CLASSES)
+    {
+        old_size = CSTR_POOL_CLASS_SIZE(class_index);
+        if (size <= old_size)
+            return ptr_to_free;
+    }
+    else
+    {
+        old_size = CSTR_POOL_SIZE_OF(ptr_to_free);
+        if (cstr_pool_class_index(size) >= CSTR_POOL_CLASSES)
+        {
+            char *block = (char *)realloc((char *)ptr_to_free - CSTR_POOL_HEADER,
+                                          CSTR_POOL_HEADER + size) +
+                          CSTR_POOL_HEADER;
+            CSTR_POOL_SIZE_OF(block) = size;
+            return block;
+        }
+    }
+
+    void *block = cstr_pool_allocate(cache, size);
+    memcpy(block, ptr_to_free, old_size < size ? old_size : size);
+    cstr_pool_release(cache, ptr_to_free);
+
+    return block;
+}
+
+const allocator pool_allocator = {&cstr_pool_run, NULL};
+
+/* sums the statistics of all threads that used the pool so far */
+cstr_pool_stats cstr_pool_get_stats(void)
+{
+    pthread_mutex_lock(&cstr_pool.lock);
+
+    cstr_pool_stats stats = cstr_pool.retired_stats;
+    for (cstr_pool_cache *cache = cstr_pool.caches; cache != NULL; cache = cache->next)
+    {
+        stats.hits += __atomic_load_n(&cache->stats.hits, __ATOMIC_RELAXED);
+        stats.misses += __atomic_load_n(&cache->stats.misses, __ATOMIC_RELAXED);
+        stats.oversized += __atomic_load_n(&cache->stats.oversized, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&cstr_pool.lock);
+
+    return stats;
+}
+
+/* gives the blocks in the global free lists back to the system */
+void cstr_pool_trim(void)
+{
+    pthread_mutex_lock(&cstr_pool.lock);
+
+    for (size_t c = 0; c < CSTR_POOL_CLASSES; c++)
+    {
+        while (cstr_pool.free_list[c] != NULL)
+        {
+            void *block = cstr_pool.free_list[c];
+            cstr_pool.free_list[c] = CSTR_POOL_NEXT(block);
+            free((char *)block - CSTR_POOL_HEADER);
+        }
+        cstr_pool.free_count[c] = 0;
+    }
+
+    pthread_mutex_unlock(&cstr_pool.lock);
+}
+
+cstr_split cstr_split_on_byte(cstr input, char sep)
+{
+    cstr_split split;
+    split.rest = input;
+    split.kind = cstr_split_byte;
+    split.set_size = 1;
+    split.set_bytes[0] = sep;
+
+    return split;
+}
+
+/*
+ * Splits on a multi-byte separator, using a precompiled pattern. An empty
+ * separator never matches, so the whole input is a single token.
+ */
+cstr_split cstr_split_on(cstr input, cstr sep)
+{
+    if (len(sep) == 1)
+        return cstr_split_on_byte(input, *ptr(sep));
+
+    cstr_split split;
+    split.rest = input;
+    split.kind = cstr_split_pattern;
+    split.pattern = cstr_pattern_compile(sep);
+
+    return split;
+}
+
+/* splits on any of the bytes in set */
+cstr_split cstr_split_on_any(cstr input, cstr set)
+{
+    if (len(set) == 1)
+        return cstr_split_on_byte(input, *ptr(set));
+
+    cstr_split split;
+    split.rest = input;
+    split.kind = cstr_split_set;
+    split.set_size = 0;
+    memset(split.set, 0, sizeof(split.set));
+
+    for (size_t i = 0; i < len(set); i++)
+    {
+        unsigned char c = (unsigned char)set.inner[i];
+        if (split.set[c >> 3] & (1u << (c & 7)))
+            continue;
+
+        split.set[c >> 3] |= (unsigned char)(1u << (c & 7));
+        if (split.set_size < CSTR_SPLIT_SIMD_SET)
+            split.set_bytes[split.set_size] = (char)c;
+        split.set_size++;
+    }
+
+    return split;
+}
+
+const char *cstr_split_find_set_scalar(const cstr_split *split, const char *begin, const char *end)
+{
+    for (; begin < end; begin++)
+    {
+        unsigned char c = (unsigned char)*begin;
+        if (split->set[c >> 3] & (1u << (c & 7)))
+            return begin;
+    }
+
+    return end;
+}
+
+#ifdef CSTR_X86_SIMD
+
+__attribute__((target("sse2")))
+const char *cstr_split_find_set_sse2(const cstr_split *split, const char *begin, const char *end)
+{
+    __m128i set_bytes[CSTR_SPLIT_SIMD_SET];
+
+    for (size_t k = 0; k < split->set_size; k++)
+        set_bytes[k] = _mm_set1_epi8(split->set_bytes[k]);
+
+    for (; end - begin >= 16; begin += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)begin);
+        __m128i hits = _mm_cmpeq_epi8(block, set_bytes[0]);
+
+        for (size_t k = 1; k < split->set_size; k++)
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, set_bytes[k]));
+
+        unsigned mask = (unsigned)_mm_movemask_epi8(hits);
+        if (mask != 0)
+            return begin + __builtin_ctz(mask);
+    }
+
+    return cstr_split_find_set_scalar(split, begin, end);
+}
+
+#endif
+
+/* returns the next separator in rest, or an empty cstr at its end */
+cstr cstr_split_find_separator(const cstr_split *split)
+{
+    const cstr rest = split->rest;
+    const char *found = end(rest);
+
+    switch (split->kind)
+    {
+    case cstr_split_byte:
+        found = (const char *)memchr(ptr(rest), split->set_bytes[0], len(rest));
+        if (found == NULL)
+            return cstr_end(rest);
+        return (cstr){.length = 1, .inner = found};
+
+    case cstr_split_set:
+#ifdef CSTR_X86_SIMD
+        if (split->set_size != 0 && split->set_size <= CSTR_SPLIT_SIMD_SET &&
+            __builtin_cpu_supports("sse2"))
+            found = cstr_split_find_set_sse2(split, ptr(rest), end(rest));
+        else
+#endif
+            found = cstr_split_find_set_scalar(split, ptr(rest), end(rest));
+        return (cstr){.length = found < end(rest) ? 1u : 0u, .inner = found};
+
+    default:
+        return cstr_pattern_find_first(&split->pattern, rest);
+    }
+}
+
+/*
+ * Yields the tokens in the same way as FOR_ITER_CSTR: empty tokens between
+ * adjacent separators are reported, a trailing empty token is not.
+ */
+bool cstr_split_next(cstr_split *split, cstr *token)
+{
+    if (len(split->rest) == 0)
+        return false;
+
+    cstr sep = cstr_split_find_separator(split);
+
+    *token = (cstr){.length = (size_t)(ptr(sep) - ptr(split->rest)), .inner = ptr(split->rest)};
+    split->rest = (cstr){.length = (size_t)(end(split->rest) - end(sep)), .inner = end(sep)};
+
+    return true;
+}
+
+/* the part of the input that was not yet split */
+cstr cstr_split_remaining(const cstr_split *split)
+{
+    return split->rest;
+}
+
+/* wyhash: 64 bit multiply-mix hash, reads input in (possibly overlapping) words */
+void cstr_hash_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t product = (__uint128_t)*a * *b;
+    *a = (uint64_t)product;
+    *b = (uint64_t)(product >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), carry = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    carry += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+uint64_t cstr_hash_mix(uint64_t a, uint64_t b)
+{
+    cstr_hash_mum(&a, &b);
+    return a ^ b;
+}
+
+uint64_t cstr_hash_read8(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+uint64_t cstr_hash_read4(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+uint64_t cstr_hash_seeded(cstr input, uint64_t seed)
+{
+    static const uint64_t secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                       0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+    const unsigned char *p = (const unsigned char *)ptr(input);
+    const size_t length = len(input);
+    uint64_t a, b;
+
+    seed ^= cstr_hash_mix(seed ^ secret[0], secret[1]);
+
+    if (length <= 16)
+    {
+        if (length >= 4)
+        {
+            a = (cstr_hash_read4(p) << 32) | cstr_hash_read4(p + ((length >> 3) << 2));
+            b = (cstr_hash_read4(p + length - 4) << 32) |
+                cstr_hash_read4(p + length - 4 - ((length >> 3) << 2));
+        }
+        else if (length > 0)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+            b = 0;
+        }
+        else
+            a = b = 0;
+    }
+    else
+    {
+        size_t i = length;
+
+        if (i >= 48)
+        {
+            uint64_t seed1 = seed, seed2 = seed;
+            do
+            {
+                seed = cstr_hash_mix(cstr_hash_read8(p) ^ secret[1], cstr_hash_read8(p + 8) ^ seed);
+                seed1 = cstr_hash_mix(cstr_hash_read8(p + 16) ^ secret[2], cstr_hash_read8(p + 24) ^ seed1);
+                seed2 = cstr_hash_mix(cstr_hash_read8(p + 32) ^ secret[3], cstr_hash_read8(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i >= 48);
+            seed ^= seed1 ^ seed2;
+        }
+
+        while (i > 16)
+        {
+            seed = cstr_hash_mix(cstr_hash_read8(p) ^ secret[1], cstr_hash_read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+
+        a = cstr_hash_read8(p + i - 16);
+        b = cstr_hash_read8(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    cstr_hash_mum(&a, &b);
+
+    return cstr_hash_mix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+
+uint64_t cstr_hash(cstr input)
+{
+    return cstr_hash_seeded(input, 0);
+}
+
+#define CSTR_MAP_MIN_CAPACITY 16
+#define CSTR_MAP_HASH(key) (cstr_hash(key) | 1)
+
+cstr_map cstr_map_new(allocator alloc)
+{
+    return (cstr_map){.entries = NULL, .capacity = 0, .count = 0, .alloc = alloc};
+}
+
+/* returns the slot holding key, or the empty slot where it would go */
+cstr_map_entry *cstr_map_find_slot(const cstr_map *map, cstr key, uint64_t hash)
+{
+    const size_t mask = map->capacity - 1;
+
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask)
+    {
+        cstr_map_entry *entry = &map->entries[i];
+
+        if (entry->hash == 0 || (entry->hash == hash && cstr_match(entry->key, key)))
+            return entry;
+    }
+}
+
+void cstr_map_grow(cstr_map *map)
+{
+    cstr_map old = *map;
+
+    map->capacity = old.capacity == 0 ? CSTR_MAP_MIN_CAPACITY : 2 * old.capacity;
+    map->entries = (cstr_map_entry *)map->alloc.run(map->alloc.context, NULL,
+                                                     map->capacity * sizeof(cstr_map_entry));
+    memset(map->entries, 0, map->capacity * sizeof(cstr_map_entry));
+
+    for (size_t i = 0; i < old.capacity; i++)
+    {
+        if (old.entries[i].hash == 0)
+            continue;
+
+        size_t slot = (size_t)old.entries[i].hash & (map->capacity - 1);
+        while (map->entries[slot].hash != 0)
+            slot = (slot + 1) & (map->capacity - 1);
+
+        map->entries[slot] = old.entries[i];
+    }
+
+    if (old.entries != NULL)
+        map->alloc.run(map->alloc.context, old.entries, 0);
+}
+
+/* returns true if key was new, an existing entry gets its value replaced */
+bool cstr_map_insert(cstr_map *map, cstr key, void *value)
+{
+    /* keep the load factor below 3/4 */
+    if (4 * (map->count + 1) > 3 * map->capacity)
+        cstr_map_grow(map);
+
+    const uint64_t hash = CSTR_MAP_HASH(key);
+    cstr_map_entry *entry = cstr_map_find_slot(map, key, hash);
+    const bool is_new = entry->hash == 0;
+
+    if (is_new)
+    {
+        entry->hash = hash;
+        entry->key = key;
+        map->count++;
+    }
+
+    entry->value = value;
+
+    return is_new;
+}
+
+/* like cstr_map_get, for callers that already computed cstr_hash(key) */
+void **cstr_map_get_hashed(const cstr_map *map, cstr key, uint64_t hash)
+{
+    if (map->count == 0)
+        return NULL;
+
+    cstr_map_entry *entry = cstr_map_find_slot(map, key, hash | 1);
+
+    return entry->hash == 0 ? NULL : &entry->value;
+}
+
+/* returns a pointer to the value stored for key, or NULL if there is none */
+void **cstr_map_get(const cstr_map *map, cstr key)
+{
+    return cstr_map_get_hashed(map, key, cstr_hash(key));
+}
+
+bool cstr_map_remove(cstr_map *map, cstr key)
+{
+    if (map->count == 0)
+        return false;
+
+    const size_t mask = map->capacity - 1;
+    cstr_map_entry *entry = cstr_map_find_slot(map, key, CSTR_MAP_HASH(key));
+
+    if (entry->hash == 0)
+        return false;
+
+    /* shift the following entries back instead of leaving a tombstone */
+    size_t hole = (size_t)(entry - map->entries);
+
+    for (size_t i = (hole + 1) & mask; map->entries[i].hash != 0; i = (i + 1) & mask)
+    {
+        size_t home = (size_t)map->entries[i].hash & mask;
+
+        /* entries whose home lies cyclically in (hole, i] have to stay */
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            map->entries[hole] = map->entries[i];
+            hole = i;
+        }
+    }
+
+    map->entries[hole].hash = 0;
+    map->count--;
+
+    return true;
+}
+
+void cstr_map_free(cstr_map map)
+{
+    if (map.entries != NULL)
+        map.alloc.run(map.alloc.context, map.entries, 0);
+}
+
+#define CSTR_INTERNER_BLOCK_SIZE 4096
+
+void cstr_interner_init(cstr_interner *interner)
+{
+    for (size_t i = 0; i < CSTR_INTERNER_SHARDS; i++)
+    {
+        cstr_interner_shard *shard = &interner->shards[i];
+
+        pthread_rwlock_init(&shard->lock, NULL);
+        shard->map = cstr_map_new(malloc_wrapper);
+        cstr_arena_init(&shard->arena, CSTR_INTERNER_BLOCK_SIZE);
+        shard->strings = NULL;
+        shard->string_count = 0;
+        shard->string_capacity = 0;
+        shard->string_bytes = 0;
+    }
+}
+
+/*
+ * Ids interleave the shards: the low bits select the shard, the rest is
+ * the position in the shard, so ids stay small and dense.
+ */
+cstr cstr_interner_insert(cstr_interner *interner, cstr input, size_t *id)
+{
+    const uint64_t hash = cstr_hash(input);
+    const size_t shard_index = (size_t)(hash >> (64 - CSTR_INTERNER_SHARD_BITS));
+    cstr_interner_shard *shard = &interner->shards[shard_index];
+
+    uintptr_t local_id = 0;
+    cstr canonical = {0, NULL};
+
+    pthread_rwlock_rdlock(&shard->lock);
+    void **found = cstr_map_get_hashed(&shard->map, input, hash);
+    if (found != NULL)
+    {
+        local_id = (uintptr_t)*found;
+        canonical = shard->strings[local_id];
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    if (found == NULL)
+    {
+        pthread_rwlock_wrlock(&shard->lock);
+
+        /* another thread may have interned it between the two locks */
+        found = cstr_map_get_hashed(&shard->map, input, hash);
+        if (found != NULL)
+            local_id = (uintptr_t)*found;
+        else
+        {
+            char *copy = cstr_arena_bump(&shard->arena, len(input));
+            memcpy(copy, ptr(input), len(input));
+
+            if (shard->string_count == shard->string_capacity)
+            {
+                shard->string_capacity = shard->string_capacity == 0 ? 64 : 2 * shard->string_capacity;
+                shard->strings = (cstr *)realloc(shard->strings, shard->string_capacity * sizeof(cstr));
+            }
+
+            local_id = shard->string_count++;
+            shard->strings[local_id] = (cstr){.length = len(input), .inner = copy};
+            shard->string_bytes += len(input);
+            cstr_map_insert(&shard->map, shard->strings[local_id], (void *)local_id);
+        }
+
+        canonical = shard->strings[local_id];
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    if (id != NULL)
+        *id = ((size_t)local_id << CSTR_INTERNER_SHARD_BITS) | shard_index;
+
+    return canonical;
+}
+
+/* returns the canonical copy of input, which lives as long as the interner */
+cstr cstr_intern(cstr_interner *interner, cstr input)
+{
+    return cstr_interner_insert(interner, input, NULL);
+}
+
+size_t cstr_intern_id(cstr_interner *interner, cstr input)
+{
+    size_t id;
+    cstr_interner_insert(interner, input, &id);
+
+    return id;
+}
+
+/* returns the string interned under id, or an empty cstr for unknown ids */
+cstr cstr_interner_lookup(cstr_interner *interner, size_t id)
+{
+    cstr_interner_shard *shard = &interner->shards[id & (CSTR_INTERNER_SHARDS - 1)];
+    const size_t local_id = id >> CSTR_INTERNER_SHARD_BITS;
+    cstr result = {0, NULL};
+
+    pthread_rwlock_rdlock(&shard->lock);
+    if (local_id < shard->string_count)
+        result = shard->strings[local_id];
+    pthread_rwlock_unlock(&shard->lock);
+
+    return result;
+}
+
+cstr_interner_stats cstr_interner_get_stats(cstr_interner *interner)
+{
+    cstr_interner_stats stats = {0, 0, 0};
+
+    for (size_t i = 0; i < CSTR_INTERNER_SHARDS; i++)
+    {
+        cstr_interner_shard *shard = &interner->shards[i];
+
+        pthread_rwlock_rdlock(&shard->lock);
+
+        stats.strings += shard->string_count;
+        stats.string_bytes += shard->string_bytes;
+        stats.allocated_bytes += shard->map.capacity * sizeof(cstr_map_entry) +
+                                 shard->string_capacity * sizeof(cstr);
+
+        for (cstr_arena_block *block = shard->arena.blocks; block != NULL; block = block->next)
+            stats.allocated_bytes += block->capacity;
+
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    return stats;
+}
+
+void cstr_interner_free(cstr_interner *interner)
+{
+    for (size_t i = 0; i < CSTR_INTERNER_SHARDS; i++)
+    {
+        cstr_interner_shard *shard = &interner->shards[i];
+
+        cstr_map_free(shard->map);
+        cstr_arena_free(&shard->arena);
+        free(shard->strings);
+        pthread_rwlock_destroy(&shard->lock);
+    }
+}
+
+#define CSTR_ROPE_MIN_CHUNK 256
+#define CSTR_ROPE_MAX_CHUNK 65536
+#define CSTR_ROPE_BUFFER(chunk) ((char *)((chunk) + 1))
+
+#define cstr_rope_append(rope, x) cstr_rope_append_impl(rope, cstr(x))
+
+#define FOR_ITER_ROPE(chunk, rope) \
+    for (const cstr_rope_chunk *chunk = (rope).head; chunk != NULL; chunk = chunk->next)
+
+cstr_rope cstr_rope_new(allocator alloc)
+{
+    return (cstr_rope){.head = NULL, .tail = NULL, .length = 0, .chunk_count = 0, .alloc = alloc};
+}
+
+void cstr_rope_link(cstr_rope *rope, cstr_rope_chunk *chunk)
+{
+    chunk->next = NULL;
+
+    if (rope->tail != NULL)
+        rope->tail->next = chunk;
+    else
+        rope->head = chunk;
+
+    rope->tail = chunk;
+    rope->chunk_count++;
+}
+
+void cstr_rope_append_impl(cstr_rope *rope, cstr input)
+{
+    cstr_rope_chunk *tail = rope->tail;
+    rope->length += len(input);
+
+    if (tail != NULL && tail->capacity > len(tail->data))
+    {
+        size_t fitting = tail->capacity - len(tail->data);
+        if (fitting > len(input))
+            fitting = len(input);
+
+        memcpy(CSTR_ROPE_BUFFER(tail) + len(tail->data), ptr(input), fitting);
+        tail->data.length += fitting;
+        input.inner += fitting;
+        input.length -= fitting;
+    }
+
+    if (len(input) == 0)
+        return;
+
+    /* chunks double in size up to a limit, large inputs get a chunk of their own */
+    size_t capacity = tail != NULL && tail->capacity != 0 ? 2 * tail->capacity : CSTR_ROPE_MIN_CHUNK;
+    if (capacity > CSTR_ROPE_MAX_CHUNK)
+        capacity = CSTR_ROPE_MAX_CHUNK;
+    if (capacity < len(input))
+        capacity = len(input);
+
+    cstr_rope_chunk *chunk = (cstr_rope_chunk *)rope->alloc.run(
+        rope->alloc.context, NULL, sizeof(cstr_rope_chunk) + capacity);
+    chunk->capacity = capacity;
+    chunk->data = (cstr){.length = len(input), .inner = CSTR_ROPE_BUFFER(chunk)};
+    memcpy(CSTR_ROPE_BUFFER(chunk), ptr(input), len(input));
+
+    cstr_rope_link(rope, chunk);
+}
+
+/* links input into the rope without copying, it has to outlive the rope */
+void cstr_rope_append_ref(cstr_rope *rope, cstr input)
+{
+    if (len(input) == 0)
+        return;
+
+    cstr_rope_chunk *chunk = (cstr_rope_chunk *)rope->alloc.run(
+        rope->alloc.context, NULL, sizeof(cstr_rope_chunk));
+    chunk->capacity = 0;
+    chunk->data = input;
+    rope->length += len(input);
+
+    cstr_rope_link(rope, chunk);
+}
+
+/* writes all chunks to fd with writev, returns false and sets errno on failure */
+bool cstr_rope_write(const cstr_rope *rope, int fd)
+{
+#ifdef IOV_MAX
+    enum { max_iov = IOV_MAX < 1024 ? IOV_MAX : 1024 };
+#else
+    enum { max_iov = 16 };
+#endif
+    struct iovec iov[max_iov];
+    const cstr_rope_chunk *chunk = rope->head;
+    size_t skip = 0;
+
+    while (chunk != NULL)
+    {
+        int count = 0;
+        const cstr_rope_chunk *it = chunk;
+
+        for (; it != NULL && count < max_iov; it = it->next, count++)
+        {
+            size_t offset = it == chunk ? skip : 0;
+            iov[count].iov_base = (void *)(ptr(it->data) + offset);
+            iov[count].iov_len = len(it->data) - offset;
+        }
+
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        /* advance past everything written, which may end inside a chunk */
+        size_t remaining = (size_t)written + skip;
+        while (chunk != NULL && remaining >= len(chunk->data))
+        {
+            remaining -= len(chunk->data);
+            chunk = chunk->next;
+        }
+        skip = remaining;
+    }
+
+    return true;
+}
+
+/* copies the rope into a single cstring, allocated exactly once */
+cstring cstr_rope_flatten(const cstr_rope *rope, allocator alloc)
+{
+    cstring result = {.length = 0, .inner = NULL, .capacity = 0, .alloc = alloc};
+
+    /* an empty result has no buffer to copy into */
+    if (rope->length == 0)
+        return result;
+
+    cstring_reserve(&result, rope->length);
+
+    FOR_ITER_ROPE(chunk, *rope)
+    {
+        memcpy(result.inner + result.length, ptr(chunk->data), len(chunk->data));
+        result.length += len(chunk->data);
+    }
+
+    return result;
+}
+
+void cstr_rope_free(cstr_rope rope)
+{
+    cstr_rope_chunk *chunk = rope.head;
+
+    while (chunk != NULL)
+    {
+        cstr_rope_chunk *next = chunk->next;
+        rope.alloc.run(rope.alloc.context, chunk, 0);
+        chunk = next;
+    }
+}
+
+/*
+ * Maps the file at path read-only and exposes it as a cstr. Empty files
+ * are not mapped and yield an empty cstr. Returns false and sets errno if
+ * the file cannot be opened or mapped. Pipes, devices and files like those
+ * in /proc cannot be mapped, or report a size of 0 whatever they contain,
+ * so they fail with ENODEV instead of looking empty; read those with
+ * cstr_reader.
+ */
+bool cstr_mmap_file(const char *path, cstr_mmap_advice advice, cstr_file_mapping *mapping)
+{
+    /* O_NONBLOCK keeps the open from waiting for a writer on a FIFO */
+    int fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    if (!S_ISREG(info.st_mode))
+    {
+        close(fd);
+        errno = ENODEV;
+        return false;
+    }
+
+    mapping->contents = (cstr){.length = 0, .inner = ""};
+    mapping->mapped_length = (size_t)info.st_size;
+
+    if (mapping->mapped_length == 0)
+    {
+        /* procfs and sysfs files claim to be empty regular files */
+        char probe;
+        ssize_t probed = read(fd, &probe, 1);
+        int saved_errno = errno;
+        close(fd);
+
+        if (probed == 0)
+            return true;
+
+        errno = probed < 0 ? saved_errno : ENODEV;
+        return false;
+    }
+
+    void *data = mmap(NULL, mapping->mapped_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    int saved_errno = errno;
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        errno = saved_errno;
+        return false;
+    }
+
+    switch (advice)
+    {
+    case cstr_mmap_sequential:
+        madvise(data, mapping->mapped_length, MADV_SEQUENTIAL);
+        break;
+
+    case cstr_mmap_random:
+        madvise(data, mapping->mapped_length, MADV_RANDOM);
+        break;
+
+    case cstr_mmap_willneed:
+        madvise(data, mapping->mapped_length, MADV_WILLNEED);
+        break;
+
+    default:
+        break;
+    }
+
+    mapping->contents = (cstr){.length = mapping->mapped_length, .inner = (const char *)data};
+
+    return true;
+}
+
+void cstr_munmap_file(cstr_file_mapping mapping)
+{
+    if (mapping.mapped_length != 0)
+        munmap((void *)mapping.contents.inner, mapping.mapped_length);
+}
+
+/* initial buffer size of a cstr_reader, doubled whenever a record does not fit */
+#define CSTR_READER_BUFFER_SIZE 65536
+
+cstr_reader cstr_reader_new(int fd, char delimiter, allocator alloc)
+{
+    return (cstr_reader){
+        .fd = fd,
+        .delimiter = delimiter,
+        .eof = false,
+        .error = 0,
+        .buffer = NULL,
+        .capacity = 0,
+        .start = 0,
+        .end = 0,
+        .scanned = 0,
+        .alloc = alloc,
+    };
+}
+
+/* makes room behind end, moving the pending record to the front or growing the buffer */
+bool cstr_reader_make_room(cstr_reader *reader)
+{
+    if (reader->start == reader->end)
+        reader->start = reader->end = 0;
+
+    if (reader->end < reader->capacity)
+        return true;
+
+    if (reader->start > 0)
+    {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        return true;
+    }
+
+    size_t capacity = reader->capacity == 0 ? CSTR_READER_BUFFER_SIZE : 2 * reader->capacity;
+    char *buffer = (char *)reader->alloc.run(reader->alloc.context, reader->buffer, capacity);
+    if (buffer == NULL)
+    {
+        reader->error = ENOMEM;
+        return false;
+    }
+
+    reader->buffer = buffer;
+    reader->capacity = capacity;
+    return true;
+}
+
+/*
+ * Stores the next record, without its delimiter, in record. A final record
+ * without a trailing delimiter is returned as well. Returns false at the end
+ * of input or on error, in which case reader->error holds the errno value.
+ */
+bool cstr_reader_next(cstr_reader *reader, cstr *record)
+{
+    while (true)
+    {
+        const char *pending = reader->buffer + reader->start;
+        size_t pending_length = reader->end - reader->start;
+
+        if (pending_length > reader->scanned)
+        {
+            const char *found = (const char *)memchr(pending + reader->scanned, reader->delimiter,
+                                                     pending_length - reader->scanned);
+            if (found != NULL)
+            {
+                *record = (cstr){.length = (size_t)(found - pending), .inner = pending};
+                reader->start += record->length + 1;
+                reader->scanned = 0;
+                return true;
+            }
+
+            reader->scanned = pending_length;
+        }
+
+        if (reader->eof)
+        {
+            if (pending_length == 0)
+                return false;
+
+            *record = (cstr){.length = pending_length, .inner = pending};
+            reader->start = reader->end;
+            reader->scanned = 0;
+            return true;
+        }
+
+        if (reader->error != 0 || !cstr_reader_make_room(reader))
+            return false;
+
+        ssize_t received = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        if (received < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            reader->error = errno;
+            return false;
+        }
+
+        if (received == 0)
+            reader->eof = true;
+
+        reader->end += (size_t)received;
+    }
+}
+
+void cstr_reader_free(cstr_reader reader)
+{
+    if (reader.buffer != NULL)
+        reader.alloc.run(reader.alloc.context, reader.buffer, 0);
+}
+
+#define CSTR_PARALLEL_CHUNK_SIZE ((size_t)1 << 20)
+#define CSTR_PARALLEL_MAX_THREADS 256
+
+typedef struct cstr_parallel_chunk
+{
+    size_t entry;
+    size_t first;
+    size_t last_end;
+    size_t count;
+    size_t output;
+} cstr_parallel_chunk;
+
+/*
+ * State shared by the workers of one parallel search. The haystack is cut
+ * into chunks of start positions, each chunk searches len(needle) - 1 bytes
+ * into the next one, so every match is found by the chunk it starts in.
+ * Workers claim chunks in increasing order from next_chunk.
+ */
+typedef struct cstr_parallel_search
+{
+    const cstr_pattern *pattern;
+    cstr haystack;
+    size_t chunk_size;
+    size_t chunk_count;
+    size_t next_chunk;
+    size_t first;
+    cstr_parallel_chunk *chunks;
+    cstr *matches;
+    size_t max_matches;
+} cstr_parallel_search;
+
+/* returns false if the search is too small to be worth splitting */
+bool cstr_parallel_init(cstr_parallel_search *search, const cstr_pattern *pattern,
+                        cstr haystack, size_t *thread_count)
+{
+    if (*thread_count == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        *thread_count = online > 0 ? (size_t)online : 1;
+    }
+
+    if (*thread_count > CSTR_PARALLEL_MAX_THREADS)
+        *thread_count = CSTR_PARALLEL_MAX_THREADS;
+
+    if (*thread_count == 1 || len(pattern->needle) == 0 ||
+        len(haystack) <= CSTR_PARALLEL_CHUNK_SIZE || len(pattern->needle) > len(haystack))
+        return false;
+
+    search->pattern = pattern;
+    search->haystack = haystack;
+    search->chunk_size = len(pattern->needle) > CSTR_PARALLEL_CHUNK_SIZE ? len(pattern->needle)
+                                                                         : CSTR_PARALLEL_CHUNK_SIZE;
+    search->chunk_count = (len(haystack) - 1) / search->chunk_size + 1;
+    search->next_chunk = 0;
+    search->first = SIZE_MAX;
+    search->chunks = NULL;
+    search->matches = NULL;
+    search->max_matches = 0;
+
+    return true;
+}
+
+size_t cstr_parallel_claim(cstr_parallel_search *search)
+{
+    return __atomic_fetch_add(&search->next_chunk, 1, __ATOMIC_RELAXED);
+}
+
+/* the bytes searched for matches that start in [begin, end of chunk) */
+cstr cstr_parallel_region(const cstr_parallel_search *search, size_t chunk, size_t begin)
+{
+    size_t end = (chunk + 1) * search->chunk_size + len(search->pattern->needle) - 1;
+    if (end > len(search->haystack))
+        end = len(search->haystack);
+
+    return (cstr){.length = end - begin, .inner = ptr(search->haystack) + begin};
+}
+
+/* runs worker on thread_count threads, the calling thread being one of them */
+void cstr_parallel_run(cstr_parallel_search *search, size_t thread_count, void *(*worker)(void *))
+{
+    pthread_t threads[CSTR_PARALLEL_MAX_THREADS];
+    size_t started = 0;
+
+    if (thread_count > search->chunk_count)
+        thread_count = search->chunk_count;
+
+    search->next_chunk = 0;
+
+    /* if a thread cannot be created, the others simply claim its chunks */
+    while (started + 1 < thread_count && pthread_create(&threads[started], NULL, worker, search) == 0)
+        started++;
+
+    worker(search);
+
+    for (size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+void *cstr_parallel_find_first_worker(void *context)
+{
+    cstr_parallel_search *search = (cstr_parallel_search *)context;
+    size_t chunk;
+
+    while ((chunk = cstr_parallel_claim(search)) < search->chunk_count)
+    {
+        size_t begin = chunk * search->chunk_size;
+
+        /* chunks are claimed in order, so all remaining ones start behind the match */
+        if (begin >= __atomic_load_n(&search->first, __ATOMIC_RELAXED))
+            break;
+
+        cstr found = cstr_pattern_find_first(search->pattern, cstr_parallel_region(search, chunk, begin));
+        if (len(found) == 0)
+            continue;
+
+        size_t position = (size_t)(ptr(found) - ptr(search->haystack));
+        size_t current = __atomic_load_n(&search->first, __ATOMIC_RELAXED);
+
+        while (position < current &&
+               !__atomic_compare_exchange_n(&search->first, &current, position, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+    }
+
+    return NULL;
+}
+
+/* non-overlapping matches starting in the chunk at or after entry, found like cstr_pattern_find_all */
+size_t cstr_parallel_scan(const cstr_parallel_search *search, size_t chunk, cstr_parallel_chunk *state,
+                          cstr *matches, size_t max_matches)
+{
+    cstr region = cstr_parallel_region(search, chunk, state->entry);
+    size_t count = 0;
+
+    state->first = SIZE_MAX;
+    state->last_end = 0;
+
+    while (true)
+    {
+        cstr found = cstr_pattern_find_first(search->pattern, region);
+        if (len(found) == 0)
+            return count;
+
+        if (count < max_matches)
+            matches[count] = found;
+        if (count == 0)
+            state->first = (size_t)(ptr(found) - ptr(search->haystack));
+        count++;
+
+        state->last_end = (size_t)(end(found) - ptr(search->haystack));
+        region = (cstr){.length = (size_t)(end(region) - end(found)), .inner = end(found)};
+    }
+}
+
+void *cstr_parallel_count_worker(void *context)
+{
+    cstr_parallel_search *search = (cstr_parallel_search *)context;
+    size_t chunk;
+
+    while ((chunk = cstr_parallel_claim(search)) < search->chunk_count)
+    {
+        cstr_parallel_chunk *state = &search->chunks[chunk];
+        state->entry = chunk * search->chunk_size;
+        state->count = cstr_parallel_scan(search, chunk, state, NULL, 0);
+    }
+
+    return NULL;
+}
+
+void *cstr_parallel_collect_worker(void *context)
+{
+    cstr_parallel_search *search = (cstr_parallel_search *)context;
+    size_t chunk;
+
+    while ((chunk = cstr_parallel_claim(search)) < search->chunk_count)
+    {
+        cstr_parallel_chunk *state = &search->chunks[chunk];
+        if (state->count == 0 || state->output >= search->max_matches)
+            continue;
+
+        cstr_parallel_scan(search, chunk, state, search->matches + state->output,
+                           search->max_matches - state->output);
+    }
+
+    return NULL;
+}
+
+/* same result as cstr_pattern_find_first, searched by up to thread_count threads (0 for one per cpu) */
+cstr cstr_pattern_find_first_parallel(const cstr_pattern *pattern, cstr haystack,
+                                      size_t thread_count)
+{
+    cstr_parallel_search search;
+
+    if (!cstr_parallel_init(&search, pattern, haystack, &thread_count))
+        return cstr_pattern_find_first(pattern, haystack);
+
+    cstr_parallel_run(&search, thread_count, &cstr_parallel_find_first_worker);
+
+    if (search.first == SIZE_MAX)
+        return cstr_end(haystack);
+
+    return (cstr){.length = len(pattern->needle), .inner = ptr(haystack) + search.first};
+}
+
+/*
+ * Same result as cstr_pattern_find_all. Every chunk first counts its matches
+ * as if no match reached into it. A chunk whose first match overlaps the
+ * last match of the previous chunk is then rescanned behind that match;
+ * this can only happen if the needle overlaps itself. With matches given,
+ * a second parallel pass writes each chunk's matches at its final offset.
+ */
+size_t cstr_pattern_find_all_parallel(const cstr_pattern *pattern, cstr haystack,
+                                      size_t thread_count, cstr *matches, size_t max_matches)
+{
+    cstr_parallel_search search;
+
+    if (!cstr_parallel_init(&search, pattern, haystack, &thread_count))
+        return cstr_pattern_find_all(pattern, haystack, matches, max_matches);
+
+    search.chunks = (cstr_parallel_chunk *)malloc_wrapper.run(
+        malloc_wrapper.context, NULL, search.chunk_count * sizeof(cstr_parallel_chunk));
+    if (search.chunks == NULL)
+        return cstr_pattern_find_all(pattern, haystack, matches, max_matches);
+
+    cstr_parallel_run(&search, thread_count, &cstr_parallel_count_worker);
+
+    size_t total = 0;
+    size_t previous_end = 0;
+
+    for (size_t chunk = 0; chunk < search.chunk_count; chunk++)
+    {
+        cstr_parallel_chunk *state = &search.chunks[chunk];
+
+        if (state->count != 0 && state->first < previous_end)
+        {
+            state->entry = previous_end;
+            state->count = cstr_parallel_scan(&search, chunk, state, NULL, 0);
+        }
+
+        state->output = total;
+        total += state->count;
+
+        if (state->count != 0)
+            previous_end = state->last_end;
+    }
+
+    if (matches != NULL && max_matches != 0)
+    {
+        search.matches = matches;
+        search.max_matches = max_matches;
+        cstr_parallel_run(&search, thread_count, &cstr_parallel_collect_worker);
+    }
+
+    malloc_wrapper.run(malloc_wrapper.context, search.chunks, 0);
+
+    return total;
+}
+
+size_t cstr_pattern_count_parallel(const cstr_pattern *pattern, cstr haystack,
+                                   size_t thread_count)
+{
+    return cstr_pattern_find_all_parallel(pattern, haystack, thread_count, NULL, 0);
+}
+
+#define CSTR_IS_DIGIT(c) ((unsigned char)((c) - '0') < 10)
+
+/* true if all eight bytes of the word are ascii digits */
+#define CSTR_SWAR_ALL_DIGITS(word)                    \
+    ((((word) & 0xF0F0F0F0F0F0F0F0ull) |              \
+      ((((word) + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull)
+
+/* value of eight ascii digits, the first digit in the lowest byte */
+uint64_t cstr_parse_eight_digits(uint64_t word)
+{
+    word -= 0x3030303030303030ull;
+    word = word * 10 + (word >> 8);
+    return (((word & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+            (((word >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+}
+
+/* parses up to 20 digits, failing on anything else or on overflow */
+bool cstr_parse_digits(const char *digits, size_t length, uint64_t *value)
+{
+    uint64_t result = 0;
+    size_t i = 0;
+
+    if (length == 0 || length > 20)
+        return false;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    /* at most 16 digits go through here, which cannot overflow */
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, digits + i, 8);
+
+        if (!CSTR_SWAR_ALL_DIGITS(word))
+            return false;
+
+        result = result * 100000000 + cstr_parse_eight_digits(word);
+    }
+#endif
+
+    for (; i < length; i++)
+    {
+        unsigned digit = (unsigned char)digits[i] - '0';
+
+        if (digit > 9 || result > (UINT64_MAX - digit) / 10)
+            return false;
+
+        result = result * 10 + digit;
+    }
+
+    *value = result;
+    return true;
+}
+
+/* parses the whole view as a decimal number with an optional '+', like strtoull without whitespace */
+bool cstr_parse_u64(cstr input, uint64_t *value)
+{
+    const char *digits = ptr(input);
+    size_t length = len(input);
+
+    if (length > 1 && *digits == '+')
+        digits++, length--;
+
+    /* leading zeros do not count against the 20 digit limit */
+    while (length > 1 && *digits == '0')
+        digits++, length--;
+
+    return cstr_parse_digits(digits, length, value);
+}
+
+bool cstr_parse_i64(cstr input, int64_t *value)
+{
+    bool negative = len(input) > 1 && *ptr(input) == '-';
+    uint64_t magnitude;
+
+    if (negative)
+        input = (cstr){.length = len(input) - 1, .inner = ptr(input) + 1};
+
+    if (len(input) != 0 && *ptr(input) == '+' && negative)
+        return false;
+
+    if (!cstr_parse_u64(input, &magnitude))
+        return false;
+
+    if (magnitude > (uint64_t)INT64_MAX + negative)
+        return false;
+
+    *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return true;
+}
+
+/* every power of ten up to 1e22 is exactly representable as a double */
+const double cstr_exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+#define CSTR_EXACT_MANTISSA ((uint64_t)1 << 53)
+
+/*
+ * strtod follows LC_NUMERIC, which may use ',' as the decimal point. The
+ * float parser switches the calling thread to a shared C locale around its
+ * strtod fallback and switches back afterwards.
+ */
+pthread_once_t cstr_c_locale_once = PTHREAD_ONCE_INIT;
+locale_t cstr_c_locale;
+
+void cstr_c_locale_create(void)
+{
+    cstr_c_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+}
+
+locale_t cstr_c_locale_begin(void)
+{
+    pthread_once(&cstr_c_locale_once, &cstr_c_locale_create);
+    if (cstr_c_locale == (locale_t)0)
+        return (locale_t)0;
+
+    return uselocale(cstr_c_locale);
+}
+
+void cstr_c_locale_end(locale_t previous)
+{
+    if (previous != (locale_t)0)
+        uselocale(previous);
+}
+
+/*
+ * Parses the whole view as a decimal floating point number, or inf/nan.
+ * If the significant digits fit into 53 bits and the exponent is at most
+ * 22, both are exact doubles and a single multiplication or division is
+ * correctly rounded. Everything else is handed to strtod in the C locale,
+ * after the syntax has been checked here. Finite input that overflows a
+ * double is rejected; input that underflows yields a subnormal or zero.
+ */
+bool cstr_parse_f64(cstr input, double *value)
+{
+    const char *it = ptr(input);
+    const char *end = end(input);
+    bool negative = false;
+
+    if (it < end && (*it == '+' || *it == '-'))
+        negative = *it++ == '-';
+
+    cstr rest = {.length = (size_t)(end - it), .inner = it};
+
+    if (cstr_match_ignore_case(rest, cstr("inf")) || cstr_match_ignore_case(rest, cstr("infinity")))
+    {
+        *value = negative ? -HUGE_VAL : HUGE_VAL;
+        return true;
+    }
+
+    if (cstr_match_ignore_case(rest, cstr("nan")))
+    {
+        *value = negative ? -NAN : NAN;
+        return true;
+    }
+
+    uint64_t mantissa = 0;
+    int significant = 0;
+    bool truncated = false;
+    long exponent = 0;
+    size_t digits = 0;
+
+    for (; it < end && CSTR_IS_DIGIT(*it); it++, digits++)
+    {
+        if (significant == 19)
+        {
+            exponent++;
+            truncated |= *it != '0';
+        }
+        else if (mantissa != 0 || *it != '0')
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*it - '0');
+            significant++;
+        }
+    }
+
+    if (it < end && *it == '.')
+    {
+        for (it++; it < end && CSTR_IS_DIGIT(*it); it++, digits++)
+        {
+            if (significant == 19)
+            {
+                truncated |= *it != '0';
+                continue;
+            }
+
+            exponent--;
+            if (mantissa != 0 || *it != '0')
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*it - '0');
+                significant++;
+            }
+        }
+    }
+
+    if (digits == 0)
+        return false;
+
+    if (it < end && (*it == 'e' || *it == 'E'))
+    {
+        bool negative_exponent = false;
+        long explicit_exponent = 0;
+
+        if (++it < end && (*it == '+' || *it == '-'))
+            negative_exponent = *it++ == '-';
+
+        if (it == end)
+            return false;
+
+        for (; it < end && CSTR_IS_DIGIT(*it); it++)
+            if (explicit_exponent < 100000)
+                explicit_exponent = explicit_exponent * 10 + (*it - '0');
+
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+
+    if (it != end)
+        return false;
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    if (!truncated && mantissa <= CSTR_EXACT_MANTISSA && exponent >= -22 && exponent <= 22)
+    {
+        double result = (double)mantissa;
+
+        if (exponent < 0)
+            result /= cstr_exact_powers_of_ten[-exponent];
+        else
+            result *= cstr_exact_powers_of_ten[exponent];
+
+        *value = negative ? -result : result;
+        return true;
+    }
+#endif
+
+    if (mantissa == 0)
+    {
+        *value = negative ? -0.0 : 0.0;
+        return true;
+    }
+
+    /* strtod needs a terminated copy, short numbers are copied onto the stack */
+    char stack_buffer[128];
+    char *buffer = stack_buffer;
+
+    if (len(input) >= sizeof(stack_buffer))
+        buffer = (char *)malloc_wrapper.run(malloc_wrapper.context, NULL, len(input) + 1);
+    if (buffer == NULL)
+        return false;
+
+    memcpy(buffer, ptr(input), len(input));
+    buffer[len(input)] = '\0';
+
+    locale_t previous = cstr_c_locale_begin();
+    double result = strtod(buffer, NULL);
+    cstr_c_locale_end(previous);
+
+    if (buffer != stack_buffer)
+        malloc_wrapper.run(malloc_wrapper.context, buffer, 0);
+
+    /* inf and nan were handled above, so an infinite result is an overflow */
+    if (isinf(result))
+        return false;
+
+    *value = result;
+    return true;
+}
+
+const char cstr_digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+size_t cstr_decimal_length(uint64_t value)
+{
+    size_t length = 1;
+
+    for (; value >= 100; value /= 100)
+        length += 2;
+
+    return length + (value >= 10);
+}
+
+/* writes the digits of value so that they end right before out */
+void cstr_format_u64(char *out, uint64_t value)
+{
+    for (; value >= 100; value /= 100)
+    {
+        out -= 2;
+        memcpy(out, &cstr_digit_pairs[(value % 100) * 2], 2);
+    }
+
+    if (value >= 10)
+        memcpy(out - 2, &cstr_digit_pairs[value * 2], 2);
+    else
+        out[-1] = (char)('0' + value);
+}
+
+void cstring_append_u64(cstring *string, uint64_t value)
+{
+    size_t length = cstr_decimal_length(value);
+
+    cstr_format_u64(cstring_grow(string, length) + length, value);
+    string->length += length;
+}
+
+void cstring_append_i64(cstring *string, int64_t value)
+{
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    size_t length = cstr_decimal_length(magnitude) + (value < 0);
+    char *out = cstring_grow(string, length);
+
+    if (value < 0)
+        *out = '-';
+
+    cstr_format_u64(out + length, magnitude);
+    string->length += length;
+}
+
+/* little endian base 2^32 integer, wide enough for the scaled values of any double */
+#define CSTR_BIGNUM_LIMBS 40
+
+typedef struct cstr_bignum
+{
+    size_t length;
+    uint32_t limbs[CSTR_BIGNUM_LIMBS];
+} cstr_bignum;
+
+void cstr_bignum_set(cstr_bignum *number, uint64_t value)
+{
+    number->limbs[0] = (uint32_t)value;
+    number->limbs[1] = (uint32_t)(value >> 32);
+    number->length = value >> 32 != 0 ? 2 : value != 0;
+}
+
+void cstr_bignum_shift_left(cstr_bignum *number, unsigned bits)
+{
+    if (number->length == 0)
+        return;
+
+    size_t words = bits / 32;
+    unsigned rest = bits % 32;
+
+    number->limbs[number->length + words] = 0;
+    for (size_t i = number->length; i-- > 0;)
+    {
+        number->limbs[i + words + 1] |= rest == 0 ? 0 : number->limbs[i] >> (32 - rest);
+        number->limbs[i + words] = number->limbs[i] << rest;
+    }
+
+    memset(number->limbs, 0, words * sizeof(uint32_t));
+    number->length += words + 1;
+    if (number->limbs[number->length - 1] == 0)
+        number->length--;
+}
+
+void cstr_bignum_multiply(cstr_bignum *number, uint32_t factor)
+{
+    uint64_t carry = 0;
+
+    for (size_t i = 0; i < number->length; i++)
+    {
+        carry += (uint64_t)number->limbs[i] * factor;
+        number->limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+
+    if (carry != 0)
+        number->limbs[number->length++] = (uint32_t)carry;
+}
+
+void cstr_bignum_multiply_pow10(cstr_bignum *number, int exponent)
+{
+    for (; exponent >= 9; exponent -= 9)
+        cstr_bignum_multiply(number, 1000000000);
+
+    for (; exponent > 0; exponent--)
+        cstr_bignum_multiply(number, 10);
+}
+
+void cstr_bignum_add(cstr_bignum *sum, const cstr_bignum *a, const cstr_bignum *b)
+{
+    const cstr_bignum *longer = a->length >= b->length ? a : b;
+    uint64_t carry = 0;
+
+    for (size_t i = 0; i < longer->length; i++)
+    {
+        carry += (uint64_t)a->limbs[i] * (i < a->length) + (uint64_t)b->limbs[i] * (i < b->length);
+        sum->limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+
+    sum->length = longer->length;
+    if (carry != 0)
+        sum->limbs[sum->length++] = (uint32_t)carry;
+}
+
+/* number -= other, other must not be larger */
+void cstr_bignum_subtract(cstr_bignum *number, const cstr_bignum *other)
+{
+    int64_t borrow = 0;
+
+    for (size_t i = 0; i < number->length; i++)
+    {
+        borrow += (int64_t)number->limbs[i] - (i < other->length ? (int64_t)other->limbs[i] : 0);
+        number->limbs[i] = (uint32_t)borrow;
+        borrow = borrow < 0 ? -1 : 0;
+    }
+
+    while (number->length != 0 && number->limbs[number->length - 1] == 0)
+        number->length--;
+}
+
+int cstr_bignum_compare(const cstr_bignum *a, const cstr_bignum *b)
+{
+    if (a->length != b->length)
+        return a->length < b->length ? -1 : 1;
+
+    for (size_t i = a->length; i-- > 0;)
+        if (a->limbs[i] != b->limbs[i])
+            return a->limbs[i] < b->limbs[i] ? -1 : 1;
+
+    return 0;
+}
+
+/* compares a + b with c */
+int cstr_bignum_compare_sum(const cstr_bignum *a, const cstr_bignum *b, const cstr_bignum *c)
+{
+    cstr_bignum sum;
+    cstr_bignum_add(&sum, a, b);
+    return cstr_bignum_compare(&sum, c);
+}
+
+#define CSTR_SHORTEST_DIGITS 20
+
+/*
+ * Writes the fewest decimal digits that read back as the positive, finite
+ * value, and sets *exponent so that value ~ d.ddd * 10^exponent. This is
+ * the free-format algorithm of Steele & White and Burger & Dybvig on exact
+ * big integers: value = r / s, and m_minus / s, m_plus / s are the
+ * distances to the halfway points towards its neighbours. Digits are
+ * produced until the remainder is within those distances, ties on the
+ * boundaries count as inside for even mantissas, as strtod rounds them
+ * there. Returns the number of digits, at most 17.
+ */
+size_t cstr_shortest_digits(double value, char *digits, int *exponent)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint64_t fraction = bits & (((uint64_t)1 << 52) - 1);
+    int biased = (int)(bits >> 52) & 0x7ff;
+    uint64_t mantissa = biased == 0 ? fraction : fraction | ((uint64_t)1 << 52);
+    int binary_exponent = (biased == 0 ? 1 : biased) - 1075;
+    bool even = (mantissa & 1) == 0;
+
+    /* the gap to the next smaller double is half as wide at a power of two */
+    bool narrow_below = fraction == 0 && biased > 1;
+
+    cstr_bignum r, s, m_plus, m_minus;
+    cstr_bignum_set(&r, mantissa);
+    cstr_bignum_set(&s, 1);
+    cstr_bignum_set(&m_plus, 1);
+    cstr_bignum_set(&m_minus, 1);
+
+    if (binary_exponent >= 0)
+    {
+        cstr_bignum_shift_left(&r, (unsigned)binary_exponent + 1 + narrow_below);
+        cstr_bignum_shift_left(&s, 1 + narrow_below);
+        cstr_bignum_shift_left(&m_plus, (unsigned)binary_exponent + narrow_below);
+        cstr_bignum_shift_left(&m_minus, (unsigned)binary_exponent);
+    }
+    else
+    {
+        cstr_bignum_shift_left(&r, 1 + narrow_below);
+        cstr_bignum_shift_left(&s, (unsigned)(1 - binary_exponent) + narrow_below);
+        cstr_bignum_shift_left(&m_plus, narrow_below);
+    }
+
+    /* estimate k with 10^(k-1) <= value < 10^k, 78913 / 2^18 is just above log10(2) */
+    int bit_length = 64 - __builtin_clzll(mantissa);
+    int k = (binary_exponent + bit_length - 1) * 78913 / (1 << 18) + 1;
+
+    if (k >= 0)
+        cstr_bignum_multiply_pow10(&s, k);
+    else
+    {
+        cstr_bignum_multiply_pow10(&r, -k);
+        cstr_bignum_multiply_pow10(&m_plus, -k);
+        cstr_bignum_multiply_pow10(&m_minus, -k);
+    }
+
+    /* the upper boundary has to stay below 1 after scaling, or reach 1 only when excluded */
+    while (cstr_bignum_compare_sum(&r, &m_plus, &s) > -even)
+    {
+        cstr_bignum_multiply(&s, 10);
+        k++;
+    }
+
+    for (;;)
+    {
+        cstr_bignum high;
+        cstr_bignum_add(&high, &r, &m_plus);
+        cstr_bignum_multiply(&high, 10);
+        if (cstr_bignum_compare(&high, &s) > -even)
+            break;
+
+        cstr_bignum_multiply(&r, 10);
+        cstr_bignum_multiply(&m_plus, 10);
+        cstr_bignum_multiply(&m_minus, 10);
+        k--;
+    }
+
+    size_t count = 0;
+
+    for (;;)
+    {
+        cstr_bignum_multiply(&r, 10);
+        cstr_bignum_multiply(&m_plus, 10);
+        cstr_bignum_multiply(&m_minus, 10);
+
+        int digit = 0;
+        while (cstr_bignum_compare(&r, &s) >= 0)
+        {
+            cstr_bignum_subtract(&r, &s);
+            digit++;
+        }
+
+        bool low = cstr_bignum_compare(&r, &m_minus) < even;
+        bool high = cstr_bignum_compare_sum(&r, &m_plus, &s) > -even;
+
+        if (!low && !high)
+        {
+            digits[count++] = (char)('0' + digit);
+            continue;
+        }
+
+        if (low && high)
+        {
+            /* both roundings read back as value, take the nearer one */
+            int nearer = cstr_bignum_compare_sum(&r, &r, &s);
+            digit += nearer > 0 || (nearer == 0 && digit % 2 == 1);
+        }
+        else if (high)
+            digit++;
+
+        digits[count++] = (char)('0' + digit);
+        break;
+    }
+
+    *exponent = k - 1;
+    return count;
+}
+
+/*
+ * Appends the shortest decimal that parses back to value. Values that are
+ * exactly m / 10^k for some m < 2^53 and k <= 17 are written as plain
+ * decimals straight from m. All others get their digits from
+ * cstr_shortest_digits and are laid out like %g: plain for decimal
+ * exponents from -4 to 16, scientific with at least two exponent digits
+ * otherwise, e.g. 1e+23 and 5e-324.
+ */
+void cstring_append_f64(cstring *string, double value)
+{
+    if (isnan(value))
+    {
+        cstring_append(string, "nan");
+        return;
+    }
+
+    if (signbit(value))
+    {
+        cstring_append(string, "-");
+        value = -value;
+    }
+
+    if (isinf(value))
+    {
+        cstring_append(string, "inf");
+        return;
+    }
+
+    for (size_t k = 0; k <= 17; k++)
+    {
+        double scaled = value * cstr_exact_powers_of_ten[k];
+        if (scaled >= (double)CSTR_EXACT_MANTISSA)
+            break;
+
+        uint64_t mantissa = (uint64_t)(scaled + 0.5);
+        if ((double)mantissa / cstr_exact_powers_of_ten[k] != value)
+            continue;
+
+        /* the integral part gets at least one digit, a leading zero if need be */
+        size_t digits = cstr_decimal_length(mantissa);
+        size_t padded = digits > k ? digits : k + 1;
+        size_t length = padded + (k != 0);
+        char *out = cstring_grow(string, length);
+
+        memset(out, '0', padded - digits);
+        cstr_format_u64(out + padded, mantissa);
+
+        if (k != 0)
+        {
+            memmove(out + padded - k + 1, out + padded - k, k);
+            out[padded - k] = '.';
+        }
+
+        string->length += length;
+        return;
+    }
+
+    char digits[CSTR_SHORTEST_DIGITS];
+    int exponent;
+    size_t count = cstr_shortest_digits(value, digits, &exponent);
+    /* at most 17 digits, a point, and "0.000" or "e+308" */
+    char *out = cstring_grow(string, 32);
+    char *it = out;
+
+    if (exponent >= 0 && exponent < 17)
+    {
+        /* integral digits, padded with zeros, then the fraction if any is left */
+        size_t integral = (size_t)exponent + 1;
+
+        for (size_t i = 0; i < integral; i++)
+            *it++ = i < count ? digits[i] : '0';
+
+        if (count > integral)
+        {
+            *it++ = '.';
+            memcpy(it, digits + integral, count - integral);
+            it += count - integral;
+        }
+    }
+    else if (exponent >= -4 && exponent < 0)
+    {
+        memcpy(it, "0.000", (size_t)(1 - exponent));
+        it += 1 - exponent;
+        memcpy(it, digits, count);
+        it += count;
+    }
+    else
+    {
+        *it++ = digits[0];
+
+        if (count > 1)
+        {
+            *it++ = '.';
+            memcpy(it, digits + 1, count - 1);
+            it += count - 1;
+        }
+
+        unsigned magnitude = (unsigned)(exponent < 0 ? -exponent : exponent);
+        size_t length = magnitude < 10 ? 2 : cstr_decimal_length(magnitude);
+
+        *it++ = 'e';
+        *it++ = exponent < 0 ? '-' : '+';
+        memset(it, '0', length);
+        cstr_format_u64(it + length, magnitude);
+        it += length;
+    }
+
+    string->length += (size_t)(it - out);
+}
+
+#define CSTR_HIGH_BITS 0x8080808080808080ull
+
+bool cstr_is_ascii_scalar(const unsigned char *input, size_t length, size_t i)
+{
+    uint64_t bits = 0;
+
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, input + i, 8);
+        bits |= word;
+    }
+
+    for (; i < length; i++)
+        bits |= input[i];
+
+    return (bits & CSTR_HIGH_BITS) == 0;
+}
+
+/*
+ * Decodes the sequence at input, rejecting overlong forms, surrogates and
+ * values above U+10FFFF. Returns its length, or 0 if it is invalid.
+ */
+size_t cstr_utf8_decode(const unsigned char *input, size_t length, uint32_t *code_point)
+{
+    unsigned char lead = input[0];
+    unsigned char min = 0x80, max = 0xBF;
+    size_t size;
+    uint32_t value;
+
+    if (lead < 0x80)
+    {
+        *code_point = lead;
+        return 1;
+    }
+
+    if (lead < 0xC2)
+        return 0;
+    else if (lead < 0xE0)
+        size = 2, value = lead & 0x1F;
+    else if (lead < 0xF0)
+    {
+        size = 3, value = lead & 0x0F;
+        if (lead == 0xE0)
+            min = 0xA0;
+        else if (lead == 0xED)
+            max = 0x9F;
+    }
+    else if (lead < 0xF5)
+    {
+        size = 4, value = lead & 0x07;
+        if (lead == 0xF0)
+            min = 0x90;
+        else if (lead == 0xF4)
+            max = 0x8F;
+    }
+    else
+        return 0;
+
+    if (length < size || input[1] < min || input[1] > max)
+        return 0;
+
+    for (size_t i = 1; i < size; i++)
+    {
+        if ((input[i] & 0xC0) != 0x80)
+            return 0;
+        value = (value << 6) | (input[i] & 0x3F);
+    }
+
+    *code_point = value;
+    return size;
+}
+
+bool cstr_utf8_validate_scalar(const unsigned char *input, size_t length, size_t i)
+{
+    while (i < length)
+    {
+        uint64_t word;
+
+        if (i + 8 <= length && (memcpy(&word, input + i, 8), (word & CSTR_HIGH_BITS) == 0))
+        {
+            i += 8;
+            continue;
+        }
+
+        uint32_t code_point;
+        size_t size = cstr_utf8_decode(input + i, length - i, &code_point);
+        if (size == 0)
+            return false;
+        i += size;
+    }
+
+    return true;
+}
+
+/* counts the bytes that are not continuation bytes (10xxxxxx) */
+size_t cstr_utf8_length_scalar(const unsigned char *input, size_t length, size_t i)
+{
+    size_t count = 0;
+
+    /* a continuation byte has its high bit set and the bit below it clear */
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, input + i, 8);
+        count += 8 - (size_t)__builtin_popcountll(word & ~(word << 1) & CSTR_HIGH_BITS);
+    }
+
+    for (; i < length; i++)
+        count += (input[i] & 0xC0) != 0x80;
+
+    return count;
+}
+
+#ifdef CSTR_X86_SIMD
+
+__attribute__((target("sse2")))
+bool cstr_is_ascii_sse2(const unsigned char *input, size_t length)
+{
+    __m128i bits = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+        bits = _mm_or_si128(bits, _mm_loadu_si128((const __m128i *)(input + i)));
+
+    return _mm_movemask_epi8(bits) == 0 && cstr_is_ascii_scalar(input, length, i);
+}
+
+__attribute__((target("avx2")))
+bool cstr_is_ascii_avx2(const unsigned char *input, size_t length)
+{
+    __m256i bits = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+        bits = _mm256_or_si256(bits, _mm256_loadu_si256((const __m256i *)(input + i)));
+
+    return _mm256_movemask_epi8(bits) == 0 && cstr_is_ascii_scalar(input, length, i);
+}
+
+__attribute__((target("sse2")))
+size_t cstr_utf8_length_sse2(const unsigned char *input, size_t length)
+{
+    const __m128i continuation_limit = _mm_set1_epi8(-65);
+    size_t count = 0;
+    size_t i = 0;
+
+    /* as signed bytes, only continuation bytes are <= -65 (0xBF) */
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(input + i));
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(block, continuation_limit)));
+    }
+
+    return count + cstr_utf8_length_scalar(input, length, i);
+}
+
+/*
+ * UTF-8 validation after Keiser and Lemire, "Validating UTF-8 In Less Than
+ * One Instruction Per Byte". Every byte is classified by table lookups on
+ * its own high nibble and the nibbles of the byte before it; the three
+ * tables flag the same bit only for invalid pairs. Errors that span more
+ * than two bytes are caught by checking that bytes two and three behind a
+ * three or four byte lead are continuations.
+ */
+#define CSTR_UTF8_TOO_SHORT (1 << 0)
+#define CSTR_UTF8_TOO_LONG (1 << 1)
+#define CSTR_UTF8_OVERLONG_3 (1 << 2)
+#define CSTR_UTF8_TOO_LARGE (1 << 3)
+#define CSTR_UTF8_SURROGATE (1 << 4)
+#define CSTR_UTF8_OVERLONG_2 (1 << 5)
+#define CSTR_UTF8_TOO_LARGE_1000 (1 << 6)
+#define CSTR_UTF8_OVERLONG_4 (1 << 6)
+#define CSTR_UTF8_TWO_CONTS (1 << 7)
+#define CSTR_UTF8_CARRY (CSTR_UTF8_TOO_SHORT | CSTR_UTF8_TOO_LONG | CSTR_UTF8_TWO_CONTS)
+
+#define CSTR_REPEAT_16(...) __VA_ARGS__, __VA_ARGS__
+
+__attribute__((target("avx2")))
+__m256i cstr_utf8_block_errors(__m256i input, __m256i previous_input)
+{
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+
+    /* the input shifted by one, two and three bytes, continuing from the previous block */
+    __m256i carried = _mm256_permute2x128_si256(previous_input, input, 0x21);
+    __m256i previous1 = _mm256_alignr_epi8(input, carried, 16 - 1);
+    __m256i previous2 = _mm256_alignr_epi8(input, carried, 16 - 2);
+    __m256i previous3 = _mm256_alignr_epi8(input, carried, 16 - 3);
+
+    const __m256i byte_1_high_table = _mm256_setr_epi8(CSTR_REPEAT_16(
+        CSTR_UTF8_TOO_LONG, CSTR_UTF8_TOO_LONG, CSTR_UTF8_TOO_LONG, CSTR_UTF8_TOO_LONG,
+        CSTR_UTF8_TOO_LONG, CSTR_UTF8_TOO_LONG, CSTR_UTF8_TOO_LONG, CSTR_UTF8_TOO_LONG,
+        CSTR_UTF8_TWO_CONTS, CSTR_UTF8_TWO_CONTS, CSTR_UTF8_TWO_CONTS, CSTR_UTF8_TWO_CONTS,
+        CSTR_UTF8_TOO_SHORT | CSTR_UTF8_OVERLONG_2,
+        CSTR_UTF8_TOO_SHORT,
+        CSTR_UTF8_TOO_SHORT | CSTR_UTF8_OVERLONG_3 | CSTR_UTF8_SURROGATE,
+        CSTR_UTF8_TOO_SHORT | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000 | CSTR_UTF8_OVERLONG_4));
+
+    const __m256i byte_1_low_table = _mm256_setr_epi8(CSTR_REPEAT_16(
+        CSTR_UTF8_CARRY | CSTR_UTF8_OVERLONG_3 | CSTR_UTF8_OVERLONG_2 | CSTR_UTF8_OVERLONG_4,
+        CSTR_UTF8_CARRY | CSTR_UTF8_OVERLONG_2,
+        CSTR_UTF8_CARRY,
+        CSTR_UTF8_CARRY,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000 | CSTR_UTF8_SURROGATE,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000,
+        CSTR_UTF8_CARRY | CSTR_UTF8_TOO_LARGE | CSTR_UTF8_TOO_LARGE_1000));
+
+    const __m256i byte_2_high_table = _mm256_setr_epi8(CSTR_REPEAT_16(
+        CSTR_UTF8_TOO_SHORT, CSTR_UTF8_TOO_SHORT, CSTR_UTF8_TOO_SHORT, CSTR_UTF8_TOO_SHORT,
+        CSTR_UTF8_TOO_SHORT, CSTR_UTF8_TOO_SHORT, CSTR_UTF8_TOO_SHORT, CSTR_UTF8_TOO_SHORT,
+        CSTR_UTF8_TOO_LONG | CSTR_UTF8_OVERLONG_2 | CSTR_UTF8_TWO_CONTS | CSTR_UTF8_OVERLONG_3 |
+            CSTR_UTF8_TOO_LARGE_1000 | CSTR_UTF8_OVERLONG_4,
+        CSTR_UTF8_TOO_LONG | CSTR_UTF8_OVERLONG_2 | CSTR_UTF8_TWO_CONTS | CSTR_UTF8_OVERLONG_3 |
+            CSTR_UTF8_TOO_LARGE,
+        CSTR_UTF8_TOO_LONG | CSTR_UTF8_OVERLONG_2 | CSTR_UTF8_TWO_CONTS | CSTR_UTF8_SURROGATE |
+            CSTR_UTF8_TOO_LARGE,
+        CSTR_UTF8_TOO_LONG | CSTR_UTF8_OVERLONG_2 | CSTR_UTF8_TWO_CONTS | CSTR_UTF8_SURROGATE |
+            CSTR_UTF8_TOO_LARGE,
+        CSTR_UTF8_TOO_SHORT, CSTR_UTF8_TOO_SHORT, CSTR_UTF8_TOO_SHORT, CSTR_UTF8_TOO_SHORT));
+
+    __m256i byte_1_high = _mm256_shuffle_epi8(
+        byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(previous1, 4), low_nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(previous1, low_nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(
+        byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble));
+    __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    /* only 111xxxxx two bytes back or 1111xxxx three bytes back keep their high bit */
+    __m256i third_byte = _mm256_subs_epu8(previous2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth_byte = _mm256_subs_epu8(previous3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third_byte, fourth_byte),
+                                             _mm256_set1_epi8((char)0x80));
+
+    return _mm256_xor_si256(must_continue, special_cases);
+}
+
+__attribute__((target("avx2")))
+bool cstr_utf8_validate_avx2(const unsigned char *input, size_t length)
+{
+    /* a lead byte in the last three positions of a block still needs continuations */
+    const __m256i incomplete_limit = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+
+    __m256i errors = _mm256_setzero_si256();
+    __m256i previous_input = _mm256_setzero_si256();
+    __m256i previous_incomplete = _mm256_setzero_si256();
+    unsigned char tail[32];
+    size_t i = 0;
+
+    while (i < length)
+    {
+        __m256i block;
+
+        if (i + 32 <= length)
+            block = _mm256_loadu_si256((const __m256i *)(input + i));
+        else
+        {
+            /* zero padding is ascii and ends nothing prematurely */
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, input + i, length - i);
+            block = _mm256_loadu_si256((const __m256i *)tail);
+        }
+
+        if (_mm256_movemask_epi8(block) == 0)
+        {
+            errors = _mm256_or_si256(errors, previous_incomplete);
+            previous_incomplete = _mm256_setzero_si256();
+        }
+        else
+        {
+            errors = _mm256_or_si256(errors, cstr_utf8_block_errors(block, previous_input));
+            previous_incomplete = _mm256_subs_epu8(block, incomplete_limit);
+        }
+
+        previous_input = block;
+        i += 32;
+    }
+
+    errors = _mm256_or_si256(errors, previous_incomplete);
+
+    return _mm256_testz_si256(errors, errors);
+}
+
+__attribute__((target("avx2")))
+size_t cstr_utf8_length_avx2(const unsigned char *input, size_t length)
+{
+    const __m256i continuation_limit = _mm256_set1_epi8(-65);
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(input + i));
+        count += (size_t)__builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(block, continuation_limit)));
+    }
+
+    return count + cstr_utf8_length_scalar(input, length, i);
+}
+
+#endif
+
+bool cstr_is_ascii(cstr input)
+{
+    const unsigned char *bytes = (const unsigned char *)ptr(input);
+
+#ifdef CSTR_X86_SIMD
+    if (len(input) >= 32 && __builtin_cpu_supports("avx2"))
+        return cstr_is_ascii_avx2(bytes, len(input));
+    if (len(input) >= 16 && __builtin_cpu_supports("sse2"))
+        return cstr_is_ascii_sse2(bytes, len(input));
+#endif
+
+    return cstr_is_ascii_scalar(bytes, len(input), 0);
+}
+
+/* true if input is well-formed UTF-8, as defined by RFC 3629 */
+bool cstr_utf8_validate(cstr input)
+{
+    const unsigned char *bytes = (const unsigned char *)ptr(input);
+
+#ifdef CSTR_X86_SIMD
+    if (len(input) >= 32 && __builtin_cpu_supports("avx2"))
+        return cstr_utf8_validate_avx2(bytes, len(input));
+#endif
+
+    return cstr_utf8_validate_scalar(bytes, len(input), 0);
+}
+
+/* number of code points in valid UTF-8 input */
+size_t cstr_utf8_length(cstr input)
+{
+    const unsigned char *bytes = (const unsigned char *)ptr(input);
+
+#ifdef CSTR_X86_SIMD
+    if (len(input) >= 32 && __builtin_cpu_supports("avx2"))
+        return cstr_utf8_length_avx2(bytes, len(input));
+    if (len(input) >= 16 && __builtin_cpu_supports("sse2"))
+        return cstr_utf8_length_sse2(bytes, len(input));
+#endif
+
+    return cstr_utf8_length_scalar(bytes, len(input), 0);
+}
+
+#define CSTR_UTF8_REPLACEMENT 0xFFFD
+
+#define FOR_ITER_UTF8(code_point, input)                                        \
+    cstr_utf8_iter UNIQUE_NAME(utf8_iter) = cstr_utf8_iter_new(cstr(input));    \
+    for (uint32_t code_point; cstr_utf8_next(&UNIQUE_NAME(utf8_iter), &code_point);)
+
+cstr_utf8_iter cstr_utf8_iter_new(cstr input)
+{
+    return (cstr_utf8_iter){.rest = input};
+}
+
+/*
+ * Stores the next code point of the input. An invalid byte yields
+ * U+FFFD and the iteration resumes at the byte after it.
+ */
+bool cstr_utf8_next(cstr_utf8_iter *iter, uint32_t *code_point)
+{
+    if (len(iter->rest) == 0)
+        return false;
+
+    size_t size = cstr_utf8_decode((const unsigned char *)ptr(iter->rest), len(iter->rest), code_point);
+    if (size == 0)
+    {
+        *code_point = CSTR_UTF8_REPLACEMENT;
+        size = 1;
+    }
+
+    iter->rest = (cstr){.length = len(iter->rest) - size, .inner = ptr(iter->rest) + size};
+    return true;
+}
+
+#define CSTR_IS_SPACE(c) ((c) == ' ' || (unsigned char)((c) - '\t') < 5)
+
+size_t cstr_skip_space_scalar(const char *input, size_t length, size_t i)
+{
+    while (i < length && CSTR_IS_SPACE(input[i]))
+        i++;
+
+    return i;
+}
+
+/* length of input without trailing whitespace, looking at the first end bytes only */
+size_t cstr_skip_space_back_scalar(const char *input, size_t end)
+{
+    while (end > 0 && CSTR_IS_SPACE(input[end - 1]))
+        end--;
+
+    return end;
+}
+
+/* flips the case of every byte in [first, first + 26), which turns ascii letters to the other case */
+void cstr_ascii_case_scalar(char *out, const char *input, size_t length, size_t i, char first)
+{
+    for (; i < length; i++)
+        out[i] = (unsigned char)(input[i] - first) < 26 ? (char)(input[i] ^ 0x20) : input[i];
+}
+
+#ifdef CSTR_X86_SIMD
+
+/* mask of the bytes that are ' ' or in '\t'..'\r' */
+__attribute__((target("sse2")))
+unsigned cstr_space_mask_sse2(__m128i block)
+{
+    __m128i blank = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+    __m128i control = _mm_cmplt_epi8(_mm_sub_epi8(block, _mm_set1_epi8((char)('\t' + 128))),
+                                     _mm_set1_epi8((char)(-128 + 5)));
+
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(blank, control));
+}
+
+__attribute__((target("sse2")))
+size_t cstr_skip_space_sse2(const char *input, size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        unsigned space = cstr_space_mask_sse2(_mm_loadu_si128((const __m128i *)(input + i)));
+        if (space != 0xFFFF)
+            return i + (size_t)__builtin_ctz(~space);
+    }
+
+    return cstr_skip_space_scalar(input, length, i);
+}
+
+__attribute__((target("sse2")))
+size_t cstr_skip_space_back_sse2(const char *input, size_t length)
+{
+    size_t end = length;
+
+    for (; end >= 16; end -= 16)
+    {
+        unsigned space = cstr_space_mask_sse2(_mm_loadu_si128((const __m128i *)(input + end - 16)));
+        if (space != 0xFFFF)
+            return end - 16 + (size_t)(32 - __builtin_clz(~space & 0xFFFF));
+    }
+
+    return cstr_skip_space_back_scalar(input, end);
+}
+
+__attribute__((target("sse2")))
+void cstr_ascii_case_sse2(char *out, const char *input, size_t length, char first)
+{
+    const __m128i offset = _mm_set1_epi8((char)(first + 128));
+    const __m128i limit = _mm_set1_epi8((char)(-128 + 26));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(input + i));
+        __m128i letter = _mm_cmplt_epi8(_mm_sub_epi8(block, offset), limit);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(block, _mm_and_si128(letter, flip)));
+    }
+
+    cstr_ascii_case_scalar(out, input, length, i, first);
+}
+
+__attribute__((target("avx2")))
+void cstr_ascii_case_avx2(char *out, const char *input, size_t length, char first)
+{
+    const __m256i offset = _mm256_set1_epi8((char)(first + 128));
+    const __m256i limit = _mm256_set1_epi8((char)(-128 + 26));
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    /* signed comparison as in sse2, avx2 only has a greater-than */
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(input + i));
+        __m256i letter = _mm256_cmpgt_epi8(limit, _mm256_sub_epi8(block, offset));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_xor_si256(block, _mm256_and_si256(letter, flip)));
+    }
+
+    cstr_ascii_case_scalar(out, input, length, i, first);
+}
+
+#endif
+
+cstr cstr_trim_start(cstr input)
+{
+    size_t start;
+
+#ifdef CSTR_X86_SIMD
+    if (len(input) >= 16 && __builtin_cpu_supports("sse2"))
+        start = cstr_skip_space_sse2(ptr(input), len(input));
+    else
+#endif
+        start = cstr_skip_space_scalar(ptr(input), len(input), 0);
+
+    return (cstr){.length = len(input) - start, .inner = ptr(input) + start};
+}
+
+cstr cstr_trim_end(cstr input)
+{
+#ifdef CSTR_X86_SIMD
+    if (len(input) >= 16 && __builtin_cpu_supports("sse2"))
+        return (cstr){.length = cstr_skip_space_back_sse2(ptr(input), len(input)), .inner = ptr(input)};
+#endif
+
+    return (cstr){.length = cstr_skip_space_back_scalar(ptr(input), len(input)), .inner = ptr(input)};
+}
+
+/* input without leading and trailing ascii whitespace */
+cstr cstr_trim(cstr input)
+{
+    return cstr_trim_end(cstr_trim_start(input));
+}
+
+void cstr_ascii_case(char *out, const char *input, size_t length, char first)
+{
+#ifdef CSTR_X86_SIMD
+    if (length >= 32 && __builtin_cpu_supports("avx2"))
+        cstr_ascii_case_avx2(out, input, length, first);
+    else if (length >= 16 && __builtin_cpu_supports("sse2"))
+        cstr_ascii_case_sse2(out, input, length, first);
+    else
+#endif
+        cstr_ascii_case_scalar(out, input, length, 0, first);
+}
+
+#define cstring_append_ascii_lower(string, x) cstring_append_ascii_lower_impl(string, cstr(x))
+#define cstring_append_ascii_upper(string, x) cstring_append_ascii_upper_impl(string, cstr(x))
+
+void cstring_append_ascii_lower_impl(cstring *string, cstr input)
+{
+    cstr_ascii_case(cstring_grow(string, len(input)), ptr(input), len(input), 'A');
+    string->length += len(input);
+}
+
+void cstring_append_ascii_upper_impl(cstring *string, cstr input)
+{
+    cstr_ascii_case(cstring_grow(string, len(input)), ptr(input), len(input), 'a');
+    string->length += len(input);
+}
+
+#define cstring_replace_all(string, needle, replacement) \
+    cstring_replace_all_impl(string, cstr(needle), cstr(replacement))
+
+#define CSTR_REPLACE_BATCH 64
+
+/*
+ * Copies input to out with every match replaced, taking the first known
+ * matches from matches instead of searching. out may be ptr(input) if the
+ * replacement is not longer than the needle.
+ */
+char *cstr_replace_pattern(char *out, cstr input, const cstr_pattern *pattern, cstr replacement,
+                           const cstr *matches, size_t known)
+{
+    const char *copied = ptr(input);
+
+    for (size_t i = 0; true; i++)
+    {
+        cstr rest = {.length = (size_t)(end(input) - copied), .inner = copied};
+        cstr found = i < known ? matches[i] : cstr_pattern_find_first(pattern, rest);
+
+        memmove(out, copied, (size_t)(ptr(found) - copied));
+        out += ptr(found) - copied;
+
+        if (len(found) == 0)
+            return out;
+
+        memcpy(out, ptr(replacement), len(replacement));
+        out += len(replacement);
+        copied = end(found);
+    }
+}
+
+/* true if input shares at least one byte with the contents of string */
+bool cstr_overlaps_cstring(cstr input, const cstring *string)
+{
+    uintptr_t begin = (uintptr_t)string->inner;
+    uintptr_t at = (uintptr_t)ptr(input);
+
+    return len(input) != 0 && string->length != 0 && at < begin + string->length && begin < at + len(input);
+}
+
+/*
+ * Replaces all non-overlapping occurrences of needle, scanning left to
+ * right like cstr_pattern_find_all. If the replacement is not longer than
+ * the needle, the string is rewritten in place. Otherwise the matches are
+ * counted first and the result is written into one exactly sized
+ * allocation. Single byte needles are counted with a vector loop. For
+ * longer needles the first CSTR_REPLACE_BATCH matches are remembered while
+ * counting, so only strings with more matches are searched a second time.
+ * needle and replacement may be slices of the string itself; they are
+ * copied before the string is touched.
+ */
+void cstring_replace_all_impl(cstring *string, cstr needle, cstr replacement)
+{
+    if (len(needle) == 0 || string->length < len(needle))
+        return;
+
+    if (cstr_overlaps_cstring(needle, string) || cstr_overlaps_cstring(replacement, string))
+    {
+        /* the in-place rewrite would change the needle or replacement under the scan */
+        char stack_buffer[128];
+        char *buffer = stack_buffer;
+        size_t total = len(needle) + len(replacement);
+
+        if (total > sizeof(stack_buffer))
+            buffer = (char *)string->alloc.run(string->alloc.context, NULL, total);
+
+        memcpy(buffer, ptr(needle), len(needle));
+        memcpy(buffer + len(needle), ptr(replacement), len(replacement));
+        cstring_replace_all_impl(string, (cstr){.length = len(needle), .inner = buffer},
+                                 (cstr){.length = len(replacement), .inner = buffer + len(needle)});
+
+        if (buffer != stack_buffer)
+            string->alloc.run(string->alloc.context, buffer, 0);
+        return;
+    }
+
+    cstr_pattern pattern = cstr_pattern_compile(needle);
+    cstr haystack = {.length = string->length, .inner = string->inner};
+
+    if (len(replacement) <= len(needle))
+    {
+        char *out = cstr_replace_pattern(string->inner, haystack, &pattern, replacement, NULL, 0);
+        string->length = (size_t)(out - string->inner);
+        return;
+    }
+
+    bool single_byte = pattern.kind == cstr_search_byte;
+    cstr matches[CSTR_REPLACE_BATCH];
+    size_t known = single_byte ? 0 : CSTR_REPLACE_BATCH;
+    size_t count = single_byte ? cstr_pattern_count(&pattern, haystack)
+                               : cstr_pattern_find_all(&pattern, haystack, matches, known);
+
+    if (count == 0)
+        return;
+
+    size_t length = string->length + count * (len(replacement) - len(needle));
+    char *output = (char *)string->alloc.run(string->alloc.context, NULL, length);
+
+    cstr_replace_pattern(output, haystack, &pattern, replacement, matches, count < known ? count : known);
+
+    string->alloc.run(string->alloc.context, string->inner, 0);
+    string->inner = output;
+    string->length = length;
+    string->capacity = length;
+}
+
+/* joins count pieces with separator between them, allocating exactly once */
+cstring cstring_join_impl(const cstr *pieces, size_t count, cstr separator, allocator alloc)
+{
+    cstring result = {.length = 0, .inner = NULL, .capacity = 0, .alloc = alloc};
+    size_t length = count == 0 ? 0 : (count - 1) * len(separator);
+
+    for (size_t i = 0; i < count; i++)
+        length += len(pieces[i]);
+
+    /* an empty result has no buffer to copy into */
+    if (length == 0)
+        return result;
+
+    cstring_reserve(&result, length);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i != 0)
+        {
+            memcpy(result.inner + result.length, ptr(separator), len(separator));
+            result.length += len(separator);
+        }
+
+        memcpy(result.inner + result.length, ptr(pieces[i]), len(pieces[i]));
+        result.length += len(pieces[i]);
+    }
+
+    return result;
+}
+
+cstring cstring_concat_impl(const cstr *pieces, size_t count, allocator alloc)
+{
+    return cstring_join_impl(pieces, count, (cstr){.length = 0, .inner = ""}, alloc);
+}
+
+#define cstring_join(pieces, count, separator, alloc) \
+    cstring_join_impl(pieces, count, cstr(separator), alloc)
+
+#ifndef __cplusplus
+
+#define CSTR_ARG_COUNT(...) \
+    CSTR_ARG_COUNT_INNER(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define CSTR_ARG_COUNT_INNER(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, n, ...) n
+
+#define CSTR_MAP_1(f, x) f(x)
+#define CSTR_MAP_2(f, x, ...) f(x), CSTR_MAP_1(f, __VA_ARGS__)
+#define CSTR_MAP_3(f, x, ...) f(x), CSTR_MAP_2(f, __VA_ARGS__)
+#define CSTR_MAP_4(f, x, ...) f(x), CSTR_MAP_3(f, __VA_ARGS__)
+#define CSTR_MAP_5(f, x, ...) f(x), CSTR_MAP_4(f, __VA_ARGS__)
+#define CSTR_MAP_6(f, x, ...) f(x), CSTR_MAP_5(f, __VA_ARGS__)
+#define CSTR_MAP_7(f, x, ...) f(x), CSTR_MAP_6(f, __VA_ARGS__)
+#define CSTR_MAP_8(f, x, ...) f(x), CSTR_MAP_7(f, __VA_ARGS__)
+#define CSTR_MAP_9(f, x, ...) f(x), CSTR_MAP_8(f, __VA_ARGS__)
+#define CSTR_MAP_10(f, x, ...) f(x), CSTR_MAP_9(f, __VA_ARGS__)
+#define CSTR_MAP_11(f, x, ...) f(x), CSTR_MAP_10(f, __VA_ARGS__)
+#define CSTR_MAP_12(f, x, ...) f(x), CSTR_MAP_11(f, __VA_ARGS__)
+#define CSTR_MAP_13(f, x, ...) f(x), CSTR_MAP_12(f, __VA_ARGS__)
+#define CSTR_MAP_14(f, x, ...) f(x), CSTR_MAP_13(f, __VA_ARGS__)
+#define CSTR_MAP_15(f, x, ...) f(x), CSTR_MAP_14(f, __VA_ARGS__)
+#define CSTR_MAP_16(f, x, ...) f(x), CSTR_MAP_15(f, __VA_ARGS__)
+#define CSTR_MAP(f, ...) CONCAT(CSTR_MAP_, CSTR_ARG_COUNT(__VA_ARGS__))(f, __VA_ARGS__)
+
+/* concatenates 1 to 16 strings of any type cstr accepts, allocating exactly once */
+#define cstring_concat(alloc, ...)                                                \
+    cstring_concat_impl((const cstr[]){CSTR_MAP(cstr, __VA_ARGS__)},              \
+                        CSTR_ARG_COUNT(__VA_ARGS__), alloc)
+
+#else
+
+template <typename... T>
+cstring cstring_concat(allocator alloc, const T &...pieces)
+{
+    const cstr views[] = {cstr_(pieces)...};
+    return cstring_concat_impl(views, sizeof...(T), alloc);
+}
+
+#endif
+
+#ifdef __cplusplus
+
+/* "text"_cs is a constant cstr whose length is known at compile time */
+constexpr cstr operator""_cs(const char *input, size_t length)
+{
+    return cstr{length, input};
+}
+
+/*
+ * Owning, move-only wrapper around cstring: the buffer is freed when the
+ * wrapper goes out of scope, copies do not compile, and a moved-from
+ * wrapper is left holding an empty string.
+ */
+class unique_cstring
+{
+  public:
+    unique_cstring() : unique_cstring(malloc_wrapper) {}
+
+    explicit unique_cstring(allocator alloc)
+    {
+        string = c_string_from_cstr(cstr{0, ""}, alloc);
+    }
+
+    template <typename T>
+    explicit unique_cstring(const T &input, allocator alloc = malloc_wrapper)
+    {
+        string = c_string_from_cstr(cstr_(input), alloc);
+    }
+
+    /* takes ownership of a cstring created by the C interface */
+    static unique_cstring adopt(cstring owned)
+    {
+        unique_cstring result(owned.alloc);
+        result.string = owned;
+        return result;
+    }
+
+    unique_cstring(const unique_cstring &) = delete;
+    unique_cstring &operator=(const unique_cstring &) = delete;
+
+    unique_cstring(unique_cstring &&other) noexcept : string(other.string)
+    {
+        other.string = c_string_from_cstr(cstr{0, ""}, string.alloc);
+    }
+
+    unique_cstring &operator=(unique_cstring &&other) noexcept
+    {
+        if (this != &other)
+        {
+            cstring_free(string);
+            string = other.string;
+            other.string = c_string_from_cstr(cstr{0, ""}, string.alloc);
+        }
+
+        return *this;
+    }
+
+    ~unique_cstring() { cstring_free(string); }
+
+    /* hands the string back to the C interface, which must cstring_free it */
+    cstring release()
+    {
+        cstring owned = string;
+        string = c_string_from_cstr(cstr{0, ""}, owned.alloc);
+        return owned;
+    }
+
+    cstring *get() { return &string; }
+    const char *data() const { return string.inner; }
+    size_t size() const { return string.length; }
+    cstr view() const { return cstr{string.length, data()}; }
+
+#ifdef CSTR_STRING_VIEW
+    operator std::string_view() const { return std::string_view(data(), size()); }
+#endif
+
+    template <typename T>
+    unique_cstring &append(const T &input)
+    {
+        cstring_append_impl(&string, cstr_(input));
+        return *this;
+    }
+
+  private:
+    cstring string;
+};
+
+cstr cstr_(const unique_cstring &input) { return input.view(); }
+
+#if __cplusplus >= 201402L
+
+/*
+ * Same tables as cstr_pattern_compile, built by the compiler, so
+ * constexpr cstr_pattern p = cstr_pattern_compile_constexpr("needle"_cs);
+ * costs nothing at run time. The cpu is unknown at compile time, so the
+ * SIMD kind follows the target flags instead of __builtin_cpu_supports.
+ */
+constexpr cstr_pattern cstr_pattern_compile_constexpr(cstr needle)
+{
+    cstr_pattern pattern{};
+    pattern.needle = needle;
+
+    if (len(needle) == 0)
+        pattern.kind = cstr_search_empty;
+    else if (len(needle) == 1)
+        pattern.kind = cstr_search_byte;
+#if defined(CSTR_X86_SIMD) && defined(__AVX2__)
+    else
+        pattern.kind = cstr_search_avx2;
+#elif defined(CSTR_X86_SIMD) && defined(__SSE2__)
+    else
+        pattern.kind = cstr_search_sse2;
+#else
+    else
+        pattern.kind = cstr_search_horspool;
+#endif
+
+    for (size_t i = 0; i < 256; i++)
+        pattern.shift[i] = len(needle);
+
+    for (size_t i = 0; i + 1 < len(needle); i++)
+        pattern.shift[(unsigned char)needle.inner[i]] = len(needle) - 1 - i;
+
+    return pattern;
+}
+
+#endif
+
+#endif
@@ -6,12 +6,35 @@
 
 /* author: Matthias Meißner (geige.matze@gmail.com) */
 
+/*
+ * the runner uses POSIX and Linux interfaces (strsignal, ftruncate, pread,
+ * clock_gettime, syscall) that a strict -std=c11 build does not declare
+ */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <stdarg.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#endif
 
 typedef enum terminal_color
 {
@@ -49,6 +72,8 @@ typedef enum muh_error_code
     MUH_NO_ERROR,
     MUH_ASSERTION_ERROR,
     MUH_MISC_ERROR,
+    MUH_CRASH_ERROR,   /* the case killed its process, see error_message */
+    MUH_TIMEOUT_ERROR, /* the case ran longer than --timeout */
 } muh_error_code;
 
 typedef struct muh_error
@@ -65,6 +90,21 @@ bool muh_contains_error(muh_error error)
            error.error_code != MUH_UNINITIALIZED_ERROR;
 }
 
+/* what a case printed to stdout or stderr, kept in memory for the report */
+typedef struct muh_output
+{
+    char *data;
+    size_t length;
+    size_t dropped; /* bytes past muh_options.output_cap that were not kept */
+} muh_output;
+
+double muh_monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
 struct muh_nit_fixture;
 
 typedef struct muh_nit_case
@@ -73,11 +113,44 @@ typedef struct muh_nit_case
     bool skip;
     void (*run)(muh_error *, void *);
     muh_error error;
-    int fd_stdout;
-    int fd_stderr;
+    muh_output captured_stdout;
+    muh_output captured_stderr;
     struct muh_nit_fixture *fixture;
+    muh_output report; /* benchmark results, printed after the case */
+    double duration;   /* seconds, wall clock */
+    double *row_durations; /* seconds per table row that ran */
+    size_t row_count;
 } muh_nit_case;
 
+typedef struct muh_nit_options
+{
+    int jobs;       /* number of forked workers */
+    bool isolate;   /* use workers even for -j 1, so crashes stay contained */
+    double timeout; /* seconds a case may run in a worker, 0 for no limit */
+    size_t output_cap; /* bytes of output kept per stream and case, 0 for no limit */
+    bool bench;        /* measure MUH_NIT_BENCH cases instead of running them once */
+    size_t bench_samples;
+    bool perf; /* add hardware counters to benchmark reports */
+    size_t slowest;     /* how many of the slowest cases to list in the summary */
+    FILE *json_report;  /* one JSON object per finished case, or NULL */
+    FILE *junit_report; /* JUnit XML, or NULL */
+} muh_nit_options;
+
+muh_nit_options muh_options = {1, false, 0, 1 << 20, false, 100, false, 0, NULL, NULL};
+
+FILE *muh_open_report(const char *path)
+{
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    return file;
+}
+
 #define MUH_CASES(...)        \
     {                         \
         __VA_ARGS__, { NULL } \
@@ -103,7 +176,13 @@ void muh_nit_table_run_test_case(muh_nit_case *test_case)
 
     while (current < self->end)
     {
+        double started = muh_monotonic_seconds();
         test_case->run(&test_case->error, current);
+
+        test_case->row_durations = (double *)realloc(
+            test_case->row_durations, (test_case->row_count + 1) * sizeof(double));
+        test_case->row_durations[test_case->row_count++] = muh_monotonic_seconds() - started;
+
         if (muh_contains_error(test_case->error))
             break;
 
@@ -151,6 +230,262 @@ void muh_nit_initializer_run_test_case(muh_nit_case *test_case)
 #define __MUH_MK_INITIALIZER_FIXTURE(type, init) \
     (muh_nit_initializer) { {&muh_nit_initializer_run_test_case}, sizeof(type), (void (*)(void *))init }
 
+/* the case being executed; MUH_CASES copies the cases, so this is not the static one */
+muh_nit_case *muh_current_case = NULL;
+
+void muh_output_appendf(muh_output *output, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (needed <= 0)
+        return;
+
+    output->data = (char *)realloc(output->data, output->length + (size_t)needed + 1);
+
+    va_start(args, format);
+    vsnprintf(output->data + output->length, (size_t)needed + 1, format, args);
+    va_end(args);
+
+    output->length += (size_t)needed;
+}
+
+/* warm-up time before sampling starts, also spent calibrating the batch size */
+#define MUH_BENCH_WARMUP_SECONDS 0.05
+/* batches are sized to take about this long, so timer overhead stays negligible */
+#define MUH_BENCH_SAMPLE_SECONDS 0.002
+
+typedef enum muh_bench_phase
+{
+    muh_bench_smoke, /* without --bench: run the body once to check it works */
+    muh_bench_start,
+    muh_bench_warmup,
+    muh_bench_sampling,
+    muh_bench_done,
+} muh_bench_phase;
+
+#define MUH_BENCH_COUNTERS 3
+
+typedef struct muh_bench
+{
+    muh_bench_phase phase;
+    size_t batch;
+    double batch_start;
+    double warmup_end;
+    double *samples; /* ns per iteration of each measured batch */
+    size_t sample_count;
+    size_t measured_iterations;
+    size_t bytes_per_op;
+    int counters[MUH_BENCH_COUNTERS]; /* perf_event fds, -1 if unavailable */
+    uint64_t counts[MUH_BENCH_COUNTERS];
+} muh_bench;
+
+const char *muh_bench_counter_names[MUH_BENCH_COUNTERS] = {"cycles", "instructions", "cache misses"};
+
+int muh_bench_open_counter(int index)
+{
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    const uint64_t configs[MUH_BENCH_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+    };
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[index];
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void)index;
+    return -1;
+#endif
+}
+
+void muh_bench_toggle_counters(muh_bench *bench, bool enable)
+{
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    for (int i = 0; i < MUH_BENCH_COUNTERS; i++)
+    {
+        if (bench->counters[i] < 0)
+            continue;
+
+        if (enable)
+        {
+            ioctl(bench->counters[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(bench->counters[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+        else
+        {
+            ioctl(bench->counters[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(bench->counters[i], &bench->counts[i], sizeof(uint64_t)) != sizeof(uint64_t))
+                bench->counts[i] = 0;
+        }
+    }
+#else
+    (void)bench;
+    (void)enable;
+#endif
+}
+
+void muh_bench_init(muh_bench *bench)
+{
+    memset(bench, 0, sizeof(*bench));
+    bench->phase = muh_options.bench ? muh_bench_start : muh_bench_smoke;
+
+    for (int i = 0; i < MUH_BENCH_COUNTERS; i++)
+        bench->counters[i] = muh_options.bench && muh_options.perf ? muh_bench_open_counter(i) : -1;
+}
+
+/*
+ * Called by MUH_BENCH_LOOP before every batch, returns how many iterations
+ * to run next or 0 when done. The first batches warm up and double in size
+ * until one takes MUH_BENCH_SAMPLE_SECONDS; after the warm-up, each batch
+ * of that calibrated size is one sample.
+ */
+size_t muh_bench_batch(muh_bench *bench)
+{
+    double now = muh_monotonic_seconds();
+    double elapsed = now - bench->batch_start;
+
+    switch (bench->phase)
+    {
+    case muh_bench_smoke:
+        bench->phase = muh_bench_done;
+        return 1;
+
+    case muh_bench_start:
+        bench->phase = muh_bench_warmup;
+        bench->warmup_end = now + MUH_BENCH_WARMUP_SECONDS;
+        bench->batch = 1;
+        break;
+
+    case muh_bench_warmup:
+        if (elapsed < MUH_BENCH_SAMPLE_SECONDS)
+            bench->batch *= 2;
+        else
+            bench->batch = (size_t)((double)bench->batch * MUH_BENCH_SAMPLE_SECONDS / elapsed) + 1;
+
+        if (now >= bench->warmup_end && elapsed >= MUH_BENCH_SAMPLE_SECONDS / 2)
+        {
+            bench->phase = muh_bench_sampling;
+            bench->samples = (double *)malloc(muh_options.bench_samples * sizeof(double));
+            muh_bench_toggle_counters(bench, true);
+        }
+        break;
+
+    case muh_bench_sampling:
+        bench->samples[bench->sample_count++] = elapsed * 1e9 / (double)bench->batch;
+        bench->measured_iterations += bench->batch;
+
+        if (bench->sample_count == muh_options.bench_samples)
+        {
+            muh_bench_toggle_counters(bench, false);
+            bench->phase = muh_bench_done;
+            return 0;
+        }
+        break;
+
+    default:
+        return 0;
+    }
+
+    bench->batch_start = muh_monotonic_seconds();
+    return bench->batch;
+}
+
+/* Newton's method, so that test binaries do not need to link libm */
+double muh_sqrt(double x)
+{
+    double root = x > 1 ? x : 1;
+
+    if (x <= 0)
+        return 0;
+
+    for (int i = 0; i < 64; i++)
+        root = (root + x / root) / 2;
+
+    return root;
+}
+
+int muh_compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* appends the statistics of a finished benchmark to the report of its case */
+void muh_bench_finish(muh_bench *bench, muh_error *error, void *data)
+{
+    muh_nit_case *test_case = muh_current_case;
+    size_t n = bench->sample_count;
+
+    if (n > 0 && !muh_contains_error(*error))
+    {
+        qsort(bench->samples, n, sizeof(double), &muh_compare_doubles);
+
+        double mean = 0;
+        for (size_t i = 0; i < n; i++)
+            mean += bench->samples[i];
+        mean /= (double)n;
+
+        double variance = 0;
+        for (size_t i = 0; i < n; i++)
+            variance += (bench->samples[i] - mean) * (bench->samples[i] - mean);
+        variance /= (double)(n > 1 ? n - 1 : 1);
+
+        double median = bench->samples[n / 2];
+        size_t p99 = (size_t)((double)n * 0.99 + 0.5);
+        p99 = p99 > 0 ? p99 - 1 : 0;
+
+        muh_output_appendf(&test_case->report, "    ");
+
+        if (test_case->fixture != NULL && test_case->fixture->run_test_case == &muh_nit_table_run_test_case)
+        {
+            muh_nit_table *table = (muh_nit_table *)test_case->fixture;
+            muh_output_appendf(&test_case->report, "row %zu: ",
+                               (size_t)((char *)data - (char *)table->data) / table->row_width);
+        }
+
+        muh_output_appendf(&test_case->report,
+                           "%.2f ns/op median, min %.2f, p99 %.2f, stddev %.2f",
+                           median, bench->samples[0], bench->samples[p99], muh_sqrt(variance));
+
+        if (bench->bytes_per_op != 0)
+            muh_output_appendf(&test_case->report, ", %.1f MB/s",
+                               (double)bench->bytes_per_op * 1e3 / median);
+
+        int opened = 0;
+        for (int i = 0; i < MUH_BENCH_COUNTERS; i++)
+            if (bench->counters[i] >= 0)
+            {
+                opened++;
+                muh_output_appendf(&test_case->report, ", %.2f %s/op",
+                                   (double)bench->counts[i] / (double)bench->measured_iterations,
+                                   muh_bench_counter_names[i]);
+            }
+
+        if (muh_options.perf && opened == 0)
+            muh_output_appendf(&test_case->report, ", no perf counters available");
+
+        muh_output_appendf(&test_case->report, "\n");
+    }
+
+    for (int i = 0; i < MUH_BENCH_COUNTERS; i++)
+        if (bench->counters[i] >= 0)
+            close(bench->counters[i]);
+
+    free(bench->samples);
+}
+
 void muh_mark_skip(muh_nit_case cases[], const char *skip_name)
 {
     for (muh_nit_case *it = cases; it->test_name != NULL; it++)
@@ -212,30 +547,338 @@ void muh_setup(int argc, const char **argv, muh_nit_case cases[])
                 break;
             }
         }
+        else if (strcmp("-j", *argv) == 0 || strcmp("--jobs", *argv) == 0)
+        {
+            if (argc == 0)
+            {
+                fputs("muh_nit: missing argument for -j\n", stderr);
+                exit(1);
+            }
+
+            argc--;
+            muh_options.jobs = atoi(*++argv);
+
+            if (muh_options.jobs == 0)
+                muh_options.jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+            if (muh_options.jobs < 1)
+            {
+                fputs("muh_nit: invalid argument for -j\n", stderr);
+                exit(1);
+            }
+        }
+        else if (strcmp("--isolate", *argv) == 0)
+        {
+            muh_options.isolate = true;
+        }
+        else if (strcmp("--timeout", *argv) == 0)
+        {
+            if (argc == 0)
+            {
+                fputs("muh_nit: missing argument for --timeout\n", stderr);
+                exit(1);
+            }
+
+            argc--;
+            muh_options.timeout = atof(*++argv);
+            muh_options.isolate = true;
+        }
+        else if (strcmp("--output-cap", *argv) == 0)
+        {
+            if (argc == 0)
+            {
+                fputs("muh_nit: missing argument for --output-cap\n", stderr);
+                exit(1);
+            }
+
+            argc--;
+            muh_options.output_cap = strtoull(*++argv, NULL, 10);
+        }
+        else if (strcmp("--bench", *argv) == 0)
+        {
+            muh_options.bench = true;
+        }
+        else if (strcmp("--bench-samples", *argv) == 0)
+        {
+            if (argc == 0)
+            {
+                fputs("muh_nit: missing argument for --bench-samples\n", stderr);
+                exit(1);
+            }
+
+            argc--;
+            muh_options.bench_samples = strtoull(*++argv, NULL, 10);
+
+            if (muh_options.bench_samples == 0)
+            {
+                fputs("muh_nit: invalid argument for --bench-samples\n", stderr);
+                exit(1);
+            }
+        }
+        else if (strcmp("--perf", *argv) == 0)
+        {
+            muh_options.perf = true;
+        }
+        else if (strcmp("--slowest", *argv) == 0)
+        {
+            if (argc == 0)
+            {
+                fputs("muh_nit: missing argument for --slowest\n", stderr);
+                exit(1);
+            }
+
+            argc--;
+            muh_options.slowest = strtoull(*++argv, NULL, 10);
+        }
+        else if (strcmp("--json", *argv) == 0)
+        {
+            if (argc == 0)
+            {
+                fputs("muh_nit: missing argument for --json\n", stderr);
+                exit(1);
+            }
+
+            argc--;
+            muh_options.json_report = muh_open_report(*++argv);
+        }
+        else if (strcmp("--junit", *argv) == 0)
+        {
+            if (argc == 0)
+            {
+                fputs("muh_nit: missing argument for --junit\n", stderr);
+                exit(1);
+            }
+
+            argc--;
+            muh_options.junit_report = muh_open_report(*++argv);
+            fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                  "<testsuite name=\"muh_nit\">\n",
+                  muh_options.junit_report);
+            fflush(muh_options.junit_report);
+        }
         argv++;
     }
 }
 
-void print_temp_file(int fd, const char *message)
+const char *muh_status_name(const muh_nit_case *test_case)
 {
-    const int buffer_len = 1024;
-    char buffer[buffer_len];
-    size_t read_len = 0;
+    switch (test_case->error.error_code)
+    {
+    case MUH_UNINITIALIZED_ERROR:
+        return "skipped";
+
+    case MUH_NO_ERROR:
+        return "passed";
+
+    case MUH_CRASH_ERROR:
+        return "crashed";
 
-    lseek(fd, 0, SEEK_SET);
+    case MUH_TIMEOUT_ERROR:
+        return "timeout";
 
-    if ((read_len = read(fd, buffer, buffer_len - 1)) != 0)
+    default:
+        return "failed";
+    }
+}
+
+void muh_write_json_string(FILE *file, const char *text, size_t length)
+{
+    fputc('"', file);
+
+    for (size_t i = 0; i < length; i++)
     {
-        buffer[read_len] = 0;
-        puts(message);
-        do
+        unsigned char c = (unsigned char)text[i];
+
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if (c == '\n')
+            fputs("\\n", file);
+        else if (c < 0x20)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+
+    fputc('"', file);
+}
+
+void muh_write_xml_text(FILE *file, const char *text, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+
+        if (c == '<')
+            fputs("&lt;", file);
+        else if (c == '>')
+            fputs("&gt;", file);
+        else if (c == '&')
+            fputs("&amp;", file);
+        else if (c == '"')
+            fputs("&quot;", file);
+        else if (c < 0x20 && c != '\n' && c != '\t' && c != '\r')
+            fputc('?', file); /* not representable in XML 1.0 */
+        else
+            fputc(c, file);
+    }
+}
+
+void muh_write_json_case(FILE *file, const muh_nit_case *test_case)
+{
+    fputs("{\"case\":", file);
+    muh_write_json_string(file, test_case->test_name, strlen(test_case->test_name));
+    fprintf(file, ",\"status\":\"%s\",\"duration_ms\":%.3f",
+            muh_status_name(test_case), test_case->duration * 1e3);
+
+    if (test_case->row_count != 0)
+    {
+        fputs(",\"rows_ms\":[", file);
+        for (size_t i = 0; i < test_case->row_count; i++)
+            fprintf(file, "%s%.3f", i == 0 ? "" : ",", test_case->row_durations[i] * 1e3);
+        fputc(']', file);
+    }
+
+    if (muh_contains_error(test_case->error))
+    {
+        const muh_error *error = &test_case->error;
+
+        fputs(",\"file\":", file);
+        muh_write_json_string(file, error->file_name, strlen(error->file_name));
+        fprintf(file, ",\"line\":%d,\"message\":", error->line_number);
+        muh_write_json_string(file, error->error_message, strlen(error->error_message));
+        fputs(",\"stdout\":", file);
+        muh_write_json_string(file, test_case->captured_stdout.data, test_case->captured_stdout.length);
+        fputs(",\"stderr\":", file);
+        muh_write_json_string(file, test_case->captured_stderr.data, test_case->captured_stderr.length);
+    }
+
+    if (test_case->report.length != 0)
+    {
+        fputs(",\"bench\":", file);
+        muh_write_json_string(file, test_case->report.data, test_case->report.length);
+    }
+
+    fputs("}\n", file);
+}
+
+void muh_write_junit_case(FILE *file, const muh_nit_case *test_case)
+{
+    fputs("  <testcase classname=\"muh_nit\" name=\"", file);
+    muh_write_xml_text(file, test_case->test_name, strlen(test_case->test_name));
+    fprintf(file, "\" time=\"%.6f\">\n", test_case->duration);
+
+    if (test_case->row_count != 0)
+    {
+        fputs("    <properties>\n", file);
+        for (size_t i = 0; i < test_case->row_count; i++)
+            fprintf(file, "      <property name=\"row %zu time\" value=\"%.6f\"/>\n",
+                    i, test_case->row_durations[i]);
+        fputs("    </properties>\n", file);
+    }
+
+    if (test_case->error.error_code == MUH_UNINITIALIZED_ERROR)
+    {
+        fputs("    <skipped/>\n", file);
+    }
+    else if (muh_contains_error(test_case->error))
+    {
+        const muh_error *error = &test_case->error;
+
+        fputs("    <failure message=\"", file);
+        muh_write_xml_text(file, error->error_message, strlen(error->error_message));
+        fprintf(file, "\" type=\"%s\">", muh_status_name(test_case));
+        muh_write_xml_text(file, error->file_name, strlen(error->file_name));
+        fprintf(file, ":%d</failure>\n", error->line_number);
+
+        fputs("    <system-out>", file);
+        muh_write_xml_text(file, test_case->captured_stdout.data, test_case->captured_stdout.length);
+        fputs("</system-out>\n    <system-err>", file);
+        muh_write_xml_text(file, test_case->captured_stderr.data, test_case->captured_stderr.length);
+        fputs("</system-err>\n", file);
+    }
+    else if (test_case->report.length != 0)
+    {
+        fputs("    <system-out>", file);
+        muh_write_xml_text(file, test_case->report.data, test_case->report.length);
+        fputs("</system-out>\n", file);
+    }
+
+    fputs("  </testcase>\n", file);
+}
+
+/* streams a finished case to the machine readable reports, flushing right away */
+void muh_report_case(const muh_nit_case *test_case)
+{
+    if (muh_options.json_report != NULL)
+    {
+        muh_write_json_case(muh_options.json_report, test_case);
+        fflush(muh_options.json_report);
+    }
+
+    if (muh_options.junit_report != NULL)
+    {
+        muh_write_junit_case(muh_options.junit_report, test_case);
+        fflush(muh_options.junit_report);
+    }
+}
+
+int muh_compare_durations(const void *a, const void *b)
+{
+    double x = (*(const muh_nit_case *const *)a)->duration;
+    double y = (*(const muh_nit_case *const *)b)->duration;
+    return (x < y) - (x > y);
+}
+
+void muh_print_slowest(muh_nit_case cases[], size_t count)
+{
+    size_t case_count = 0;
+    for (muh_nit_case *it = cases; it->test_name != NULL; it++)
+        case_count++;
+
+    muh_nit_case **sorted = (muh_nit_case **)malloc((case_count + 1) * sizeof(muh_nit_case *));
+    for (size_t i = 0; i < case_count; i++)
+        sorted[i] = &cases[i];
+
+    qsort(sorted, case_count, sizeof(muh_nit_case *), &muh_compare_durations);
+
+    if (count > case_count)
+        count = case_count;
+
+    printf("\nslowest %zu cases:\n", count);
+    for (size_t i = 0; i < count; i++)
+    {
+        printf("%10.3f ms  %s", sorted[i]->duration * 1e3, sorted[i]->test_name);
+
+        if (sorted[i]->row_count != 0)
         {
-            printf("%s", buffer);
-        } while (read(fd, buffer, buffer_len) != 0);
+            size_t slowest_row = 0;
+            for (size_t row = 1; row < sorted[i]->row_count; row++)
+                if (sorted[i]->row_durations[row] > sorted[i]->row_durations[slowest_row])
+                    slowest_row = row;
+
+            printf(" (%zu rows, slowest: row %zu with %.3f ms)", sorted[i]->row_count,
+                   slowest_row, sorted[i]->row_durations[slowest_row] * 1e3);
+        }
+
+        putchar('\n');
+    }
+
+    free(sorted);
+}
+
+void muh_print_output(muh_output *output, const char *message)
+{
+    if (output->length != 0)
+    {
+        puts(message);
+        fwrite(output->data, 1, output->length, stdout);
+        if (output->dropped != 0)
+            printf("\n[%zu more bytes not kept, see --output-cap]", output->dropped);
         puts("\n*****");
     }
 
-    close(fd);
+    free(output->data);
+    *output = (muh_output){NULL, 0, 0};
 }
 
 void muh_print_error(muh_nit_case *test_case)
@@ -251,8 +894,8 @@ void muh_print_error(muh_nit_case *test_case)
            test_case->error.line_number,
            test_case->error.error_message);
 
-    print_temp_file(test_case->fd_stdout, "contents of stdout:");
-    print_temp_file(test_case->fd_stderr, "contents of stderr:");
+    muh_print_output(&test_case->captured_stdout, "contents of stdout:");
+    muh_print_output(&test_case->captured_stderr, "contents of stderr:");
 }
 
 bool muh_nit_evaluate(muh_nit_case cases[])
@@ -278,69 +921,631 @@ bool muh_nit_evaluate(muh_nit_case cases[])
             break;
         }
 
+    if (muh_options.slowest != 0)
+        muh_print_slowest(cases, muh_options.slowest);
+
     printf("\n%d passed, %d failures, %d skipped\n",
            passed_tests, failed_tests, skipped_tests);
 
+    if (muh_options.json_report != NULL)
+        fclose(muh_options.json_report);
+
+    if (muh_options.junit_report != NULL)
+    {
+        fputs("</testsuite>\n", muh_options.junit_report);
+        fclose(muh_options.junit_report);
+    }
+
+    for (muh_nit_case *it = cases; it->test_name != NULL; it++)
+        free(it->row_durations);
+
     return (failed_tests > 0);
 }
 
-int redirect_stream(FILE *stream)
+/*
+ * Output of a case goes to an in-memory file (memfd) that is reused for
+ * every case, so capturing costs a truncate and a dup2 instead of creating
+ * and unlinking a file on disk. saved keeps the original descriptor around
+ * to restore the stream afterwards.
+ */
+typedef struct muh_capture
+{
+    int file;
+    int saved;
+} muh_capture;
+
+muh_capture muh_capture_stdout = {-1, -1};
+muh_capture muh_capture_stderr = {-1, -1};
+
+int muh_make_capture_file(void)
 {
-    int stream_fd = fileno(stream);
-    char name_template[] = "muh_test_%04d_XXXXXX";
-    sprintf(name_template, name_template, stream_fd);
-    int fd = mkstemp(name_template);
-    dup2(fd, stream_fd);
+#ifdef SYS_memfd_create
+    int fd = (int)syscall(SYS_memfd_create, "muh_nit_capture", 0);
+    if (fd >= 0)
+        return fd;
+#endif
+
+    char name_template[] = "muh_test_output_XXXXXX";
+    int fd_on_disk = mkstemp(name_template);
     unlink(name_template);
-    return fd;
+    return fd_on_disk;
 }
 
-void muh_nit_run_case(muh_nit_case *test_case)
+/* points stream at the start of its emptied capture file */
+void muh_capture_begin(muh_capture *capture, FILE *stream)
 {
-    printf("running %s... ", test_case->test_name);
-    fflush(stdout);
+    fflush(stream);
 
-    if (test_case->skip)
-    {
-        muh_set_terminal_color(terminal_color_yellow);
-        puts("skipped");
-        muh_set_terminal_color(terminal_color_default);
-        return;
-    }
+    if (capture->file < 0)
+        capture->file = muh_make_capture_file();
+
+    if (ftruncate(capture->file, 0) != 0)
+        perror("muh_nit: ftruncate");
+
+    lseek(capture->file, 0, SEEK_SET);
+    dup2(capture->file, fileno(stream));
+}
+
+/* copies at most muh_options.output_cap bytes of a capture file into memory */
+muh_output muh_capture_read(const muh_capture *capture)
+{
+    muh_output output = {NULL, 0, 0};
+    struct stat info;
+
+    if (fstat(capture->file, &info) != 0 || info.st_size <= 0)
+        return output;
+
+    size_t size = (size_t)info.st_size;
+    size_t kept = muh_options.output_cap != 0 && size > muh_options.output_cap
+                      ? muh_options.output_cap
+                      : size;
+
+    output.data = (char *)malloc(kept);
+    ssize_t read_len = pread(capture->file, output.data, kept, 0);
+
+    output.length = read_len > 0 ? (size_t)read_len : 0;
+    output.dropped = size - output.length;
+    return output;
+}
+
+/* points stream back at the descriptor it had before the first capture */
+void muh_capture_end(muh_capture *capture, FILE *stream)
+{
+    fflush(stream);
+    dup2(capture->saved, fileno(stream));
+}
 
-    test_case->fd_stdout = redirect_stream(stdout);
-    test_case->fd_stderr = redirect_stream(stderr);
+/* runs the case with stdout and stderr already captured by the caller */
+void muh_nit_execute_case(muh_nit_case *test_case)
+{
+    muh_current_case = test_case;
+    double started = muh_monotonic_seconds();
 
     if (test_case->fixture != NULL)
         test_case->fixture->run_test_case(test_case);
     else
         test_case->run(&test_case->error, NULL);
 
+    test_case->duration = muh_monotonic_seconds() - started;
+
     if (test_case->error.error_code == MUH_UNINITIALIZED_ERROR)
         test_case->error.error_code = MUH_NO_ERROR;
 
-    freopen("/dev/tty", "w", stdout);
-    freopen("/dev/tty", "w", stderr);
+    fflush(stdout);
+    fflush(stderr);
+}
 
+void muh_print_result(muh_nit_case *test_case)
+{
     if (!muh_contains_error(test_case->error))
     {
-        close(test_case->fd_stdout);
-        close(test_case->fd_stderr);
-
         muh_set_terminal_color(terminal_color_green);
         puts("ok");
         muh_set_terminal_color(terminal_color_default);
+
+        if (test_case->report.length != 0)
+            fwrite(test_case->report.data, 1, test_case->report.length, stdout);
     }
     else
     {
         muh_set_terminal_color(terminal_color_red);
-        puts("failed");
+        switch (test_case->error.error_code)
+        {
+        case MUH_CRASH_ERROR:
+            puts("crashed");
+            break;
+
+        case MUH_TIMEOUT_ERROR:
+            puts("timed out");
+            break;
+
+        default:
+            puts("failed");
+            break;
+        }
+        muh_set_terminal_color(terminal_color_default);
+    }
+
+    muh_report_case(test_case);
+    free(test_case->report.data);
+    test_case->report = (muh_output){NULL, 0, 0};
+}
+
+void muh_nit_run_case(muh_nit_case *test_case)
+{
+    printf("running %s... ", test_case->test_name);
+    fflush(stdout);
+
+    if (test_case->skip)
+    {
+        muh_set_terminal_color(terminal_color_yellow);
+        puts("skipped");
         muh_set_terminal_color(terminal_color_default);
+        muh_report_case(test_case);
+        return;
+    }
+
+    if (muh_capture_stdout.saved < 0)
+    {
+        muh_capture_stdout.saved = dup(fileno(stdout));
+        muh_capture_stderr.saved = dup(fileno(stderr));
+    }
+
+    muh_capture_begin(&muh_capture_stdout, stdout);
+    muh_capture_begin(&muh_capture_stderr, stderr);
+
+    muh_nit_execute_case(test_case);
+
+    muh_capture_end(&muh_capture_stdout, stdout);
+    muh_capture_end(&muh_capture_stderr, stderr);
+
+    if (muh_contains_error(test_case->error))
+    {
+        test_case->captured_stdout = muh_capture_read(&muh_capture_stdout);
+        test_case->captured_stderr = muh_capture_read(&muh_capture_stderr);
+    }
+
+    muh_print_result(test_case);
+}
+
+/*
+ * What a worker sends back when it starts a case and when it finishes it,
+ * the latter followed by the captured stdout and stderr of failed cases.
+ * Workers are forked, not exec'd, so the file name and message pointers
+ * inside error are valid in the parent as well.
+ */
+typedef struct muh_nit_result
+{
+    size_t case_index;
+    bool finished;
+    muh_error error;
+    muh_output captured_stdout; /* only length and dropped are meaningful */
+    muh_output captured_stderr;
+    muh_output report;
+    muh_output row_durations; /* the doubles of muh_nit_case, as bytes */
+    double duration;
+} muh_nit_result;
+
+/* one worker process and the capture files it shares with the parent */
+typedef struct muh_nit_worker_slot
+{
+    pid_t pid;
+    muh_capture capture_stdout;
+    muh_capture capture_stderr;
+    size_t current; /* pending index of the running case, SIZE_MAX if idle */
+    double started;
+} muh_nit_worker_slot;
+
+typedef struct muh_nit_pool
+{
+    muh_nit_case **pending;
+    size_t pending_count;
+    size_t *next; /* shared with the workers */
+    int jobs;
+    muh_nit_worker_slot *slots;
+    struct pollfd *results; /* read ends of the result pipes, -1 once closed */
+} muh_nit_pool;
+
+bool muh_write_all(int fd, const void *data, size_t length)
+{
+    const char *it = (const char *)data;
+
+    while (length > 0)
+    {
+        ssize_t written = write(fd, it, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        it += written;
+        length -= (size_t)written;
+    }
+
+    return true;
+}
+
+bool muh_read_all(int fd, void *data, size_t length)
+{
+    char *it = (char *)data;
+
+    while (length > 0)
+    {
+        ssize_t read_len = read(fd, it, length);
+        if (read_len < 0 && errno == EINTR)
+            continue;
+        if (read_len <= 0)
+            return false;
+
+        it += read_len;
+        length -= (size_t)read_len;
     }
+
+    return true;
+}
+
+void muh_nit_worker(muh_nit_pool *pool, muh_nit_worker_slot *slot, int result_fd)
+{
+    for (;;)
+    {
+        size_t index = __atomic_fetch_add(pool->next, 1, __ATOMIC_RELAXED);
+        if (index >= pool->pending_count)
+            break;
+
+        muh_nit_case *test_case = pool->pending[index];
+        muh_nit_result result = {index, false, {MUH_UNINITIALIZED_ERROR, 0, NULL, NULL},
+                                 {NULL, 0, 0}, {NULL, 0, 0}, {NULL, 0, 0}, {NULL, 0, 0}, 0};
+
+        if (!muh_write_all(result_fd, &result, sizeof(result)))
+            _exit(1);
+
+        /* the parent reads these files itself if the case never returns */
+        muh_capture_begin(&slot->capture_stdout, stdout);
+        muh_capture_begin(&slot->capture_stderr, stderr);
+        muh_nit_execute_case(test_case);
+
+        result.finished = true;
+        result.error = test_case->error;
+
+        if (muh_contains_error(test_case->error))
+        {
+            result.captured_stdout = muh_capture_read(&slot->capture_stdout);
+            result.captured_stderr = muh_capture_read(&slot->capture_stderr);
+        }
+
+        result.report = test_case->report;
+        result.row_durations.data = (char *)test_case->row_durations;
+        result.row_durations.length = test_case->row_count * sizeof(double);
+        result.duration = test_case->duration;
+
+        if (!muh_write_all(result_fd, &result, sizeof(result)) ||
+            !muh_write_all(result_fd, result.captured_stdout.data, result.captured_stdout.length) ||
+            !muh_write_all(result_fd, result.captured_stderr.data, result.captured_stderr.length) ||
+            !muh_write_all(result_fd, result.report.data, result.report.length) ||
+            !muh_write_all(result_fd, result.row_durations.data, result.row_durations.length))
+            _exit(1);
+
+        free(result.captured_stdout.data);
+        free(result.captured_stderr.data);
+        free(result.report.data);
+        free(result.row_durations.data);
+    }
+
+    _exit(0);
+}
+
+void muh_nit_spawn(muh_nit_pool *pool, int slot_index)
+{
+    muh_nit_worker_slot *slot = &pool->slots[slot_index];
+    int result_pipe[2];
+
+    if (pipe(result_pipe) != 0)
+    {
+        perror("muh_nit: pipe");
+        exit(1);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("muh_nit: fork");
+        exit(1);
+    }
+
+    if (pid == 0)
+    {
+        for (int i = 0; i < pool->jobs; i++)
+            if (pool->results[i].fd >= 0)
+                close(pool->results[i].fd);
+
+        close(result_pipe[0]);
+        muh_nit_worker(pool, slot, result_pipe[1]);
+    }
+
+    close(result_pipe[1]);
+    slot->pid = pid;
+    slot->current = SIZE_MAX;
+    pool->results[slot_index].fd = result_pipe[0];
+    pool->results[slot_index].events = POLLIN;
+}
+
+/* records how the running case of a dead worker ended, with what it printed so far */
+void muh_nit_abort_case(muh_nit_pool *pool, muh_nit_worker_slot *slot, muh_error error)
+{
+    muh_nit_case *test_case = pool->pending[slot->current];
+
+    test_case->captured_stdout = muh_capture_read(&slot->capture_stdout);
+    test_case->captured_stderr = muh_capture_read(&slot->capture_stderr);
+    test_case->error = error;
+    test_case->duration = muh_monotonic_seconds() - slot->started;
+    slot->current = SIZE_MAX;
+
+    printf("running %s... ", test_case->test_name);
+    muh_print_result(test_case);
+    fflush(stdout);
+}
+
+/* closes a worker's pipe, reaps it and, if cases are left, starts a replacement */
+void muh_nit_retire(muh_nit_pool *pool, int slot_index, int status)
+{
+    muh_nit_worker_slot *slot = &pool->slots[slot_index];
+
+    close(pool->results[slot_index].fd);
+    pool->results[slot_index].fd = -1;
+
+    if (slot->current != SIZE_MAX)
+    {
+        char message[128];
+
+        if (WIFSIGNALED(status))
+            snprintf(message, sizeof(message), "killed by signal %d (%s)",
+                     WTERMSIG(status), strsignal(WTERMSIG(status)));
+        else
+            snprintf(message, sizeof(message), "worker exited with status %d",
+                     WEXITSTATUS(status));
+
+        /* the message has to outlive the run, like the literals of MUH_FAIL */
+        muh_nit_abort_case(pool, slot, (muh_error){MUH_CRASH_ERROR, 0, "muh_nit", strdup(message)});
+    }
+
+    if (__atomic_load_n(pool->next, __ATOMIC_RELAXED) < pool->pending_count)
+        muh_nit_spawn(pool, slot_index);
+}
+
+/* handles one message from a worker, returns false once the worker is gone */
+bool muh_nit_receive(muh_nit_pool *pool, int slot_index)
+{
+    muh_nit_worker_slot *slot = &pool->slots[slot_index];
+    int fd = pool->results[slot_index].fd;
+    muh_nit_result result;
+
+    if (!muh_read_all(fd, &result, sizeof(result)))
+        return false;
+
+    if (!result.finished)
+    {
+        slot->current = result.case_index;
+        slot->started = muh_monotonic_seconds();
+        return true;
+    }
+
+    muh_output *outputs[] = {&result.captured_stdout, &result.captured_stderr,
+                             &result.report, &result.row_durations};
+
+    for (int i = 0; i < 4; i++)
+    {
+        outputs[i]->data = NULL;
+        if (outputs[i]->length == 0)
+            continue;
+
+        outputs[i]->data = (char *)malloc(outputs[i]->length);
+
+        if (!muh_read_all(fd, outputs[i]->data, outputs[i]->length))
+        {
+            free(result.captured_stdout.data);
+            free(result.captured_stderr.data);
+            free(result.report.data);
+            free(result.row_durations.data);
+            return false;
+        }
+    }
+
+    muh_nit_case *test_case = pool->pending[result.case_index];
+    test_case->error = result.error;
+    test_case->captured_stdout = result.captured_stdout;
+    test_case->captured_stderr = result.captured_stderr;
+    test_case->report = result.report;
+    test_case->row_durations = (double *)result.row_durations.data;
+    test_case->row_count = result.row_durations.length / sizeof(double);
+    test_case->duration = result.duration;
+    slot->current = SIZE_MAX;
+
+    printf("running %s... ", test_case->test_name);
+    muh_print_result(test_case);
+    fflush(stdout);
+    return true;
+}
+
+/* handles the messages a worker has already sent, returns false once the worker is gone */
+bool muh_nit_drain(muh_nit_pool *pool, int slot_index)
+{
+    struct pollfd ready = {pool->results[slot_index].fd, POLLIN, 0};
+
+    while (poll(&ready, 1, 0) > 0)
+        if (!muh_nit_receive(pool, slot_index))
+            return false;
+
+    return true;
+}
+
+/* kills workers whose case ran past muh_options.timeout, returns ms until the next deadline */
+int muh_nit_enforce_timeouts(muh_nit_pool *pool)
+{
+    if (muh_options.timeout <= 0)
+        return -1;
+
+    double now = muh_monotonic_seconds();
+    double next_deadline = -1;
+
+    for (int i = 0; i < pool->jobs; i++)
+    {
+        muh_nit_worker_slot *slot = &pool->slots[i];
+
+        if (pool->results[i].fd < 0 || slot->current == SIZE_MAX)
+            continue;
+
+        double left = slot->started + muh_options.timeout - now;
+
+        if (left <= 0)
+        {
+            /* the case may have finished while the parent was printing other results */
+            size_t expired = slot->current;
+
+            if (!muh_nit_drain(pool, i))
+            {
+                int status = 0;
+                waitpid(slot->pid, &status, 0);
+                muh_nit_retire(pool, i, status);
+                continue;
+            }
+
+            if (slot->current == expired)
+            {
+                kill(slot->pid, SIGKILL);
+                waitpid(slot->pid, NULL, 0);
+                muh_nit_abort_case(pool, slot, (muh_error){MUH_TIMEOUT_ERROR, 0, "muh_nit", "exceeded --timeout"});
+                muh_nit_retire(pool, i, 0);
+                continue;
+            }
+
+            if (slot->current == SIZE_MAX)
+                continue;
+
+            left = slot->started + muh_options.timeout - now;
+        }
+
+        if (next_deadline < 0 || left < next_deadline)
+            next_deadline = left;
+    }
+
+    return next_deadline < 0 ? -1 : (int)(next_deadline * 1000) + 1;
+}
+
+/*
+ * Runs the cases in muh_options.jobs forked workers. Each worker claims the
+ * next pending case from a counter in shared memory, captures its output
+ * into files it shares with the parent and streams the result back through
+ * its own pipe, so results are printed as they finish, not in declaration
+ * order. A worker that crashes or runs past the timeout takes only its
+ * current case down with it and is replaced by a fresh one.
+ */
+void muh_nit_run_workers(muh_nit_case muh_cases[])
+{
+    size_t case_count = 0;
+    for (muh_nit_case *it = muh_cases; it->test_name != NULL; it++)
+        case_count++;
+
+    muh_nit_pool pool;
+    pool.pending = (muh_nit_case **)malloc((case_count + 1) * sizeof(muh_nit_case *));
+    pool.pending_count = 0;
+
+    for (muh_nit_case *it = muh_cases; it->test_name != NULL; it++)
+    {
+        if (it->skip)
+            muh_nit_run_case(it);
+        else
+            pool.pending[pool.pending_count++] = it;
+    }
+
+    pool.next = (size_t *)mmap(NULL, sizeof(size_t), PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (pool.next == MAP_FAILED)
+    {
+        perror("muh_nit: mmap");
+        exit(1);
+    }
+    *pool.next = 0;
+
+    pool.jobs = muh_options.jobs;
+    if ((size_t)pool.jobs > pool.pending_count)
+        pool.jobs = (int)pool.pending_count;
+
+    pool.slots = (muh_nit_worker_slot *)malloc((size_t)(pool.jobs + 1) * sizeof(muh_nit_worker_slot));
+    pool.results = (struct pollfd *)malloc((size_t)(pool.jobs + 1) * sizeof(struct pollfd));
+
+    for (int i = 0; i < pool.jobs; i++)
+    {
+        pool.slots[i].capture_stdout = (muh_capture){muh_make_capture_file(), -1};
+        pool.slots[i].capture_stderr = (muh_capture){muh_make_capture_file(), -1};
+        pool.results[i].fd = -1;
+    }
+
+    for (int i = 0; i < pool.jobs; i++)
+        muh_nit_spawn(&pool, i);
+
+    for (;;)
+    {
+        int wait_ms = muh_nit_enforce_timeouts(&pool);
+        int running = 0;
+
+        for (int i = 0; i < pool.jobs; i++)
+            running += pool.results[i].fd >= 0;
+
+        if (running == 0)
+            break;
+
+        if (poll(pool.results, (nfds_t)pool.jobs, wait_ms) <= 0)
+            continue;
+
+        for (int i = 0; i < pool.jobs; i++)
+        {
+            if (pool.results[i].fd < 0 || pool.results[i].revents == 0)
+                continue;
+
+            if (!muh_nit_receive(&pool, i))
+            {
+                int status = 0;
+                waitpid(pool.slots[i].pid, &status, 0);
+                muh_nit_retire(&pool, i, status);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < pool.pending_count; i++)
+    {
+        if (pool.pending[i]->error.error_code == MUH_UNINITIALIZED_ERROR)
+        {
+            pool.pending[i]->error = (muh_error){MUH_MISC_ERROR, 0, "muh_nit", "worker exited before reporting"};
+            printf("running %s... ", pool.pending[i]->test_name);
+            muh_print_result(pool.pending[i]);
+        }
+    }
+
+    for (int i = 0; i < pool.jobs; i++)
+    {
+        close(pool.slots[i].capture_stdout.file);
+        close(pool.slots[i].capture_stderr.file);
+    }
+
+    munmap(pool.next, sizeof(size_t));
+    free(pool.results);
+    free(pool.slots);
+    free(pool.pending);
 }
 
 void muh_nit_run(muh_nit_case muh_cases[])
 {
+    if (muh_options.jobs > 1 || muh_options.isolate)
+    {
+        muh_nit_run_workers(muh_cases);
+        return;
+    }
+
     for (muh_nit_case *it = muh_cases; it->test_name != NULL; it++)
     {
         muh_nit_run_case(it);
@@ -350,18 +1555,64 @@ void muh_nit_run(muh_nit_case muh_cases[])
 #define __MUH_FIX_DATA_ARG __fixture_data
 #define __MUH_ERR_ARG __muh_error_res
 
-#define MUH_NIT_CASE(case_ident, ...)                    \
-    void case_ident##__inner_fun(muh_error *, void *);   \
+/* cases without assertions or fixtures leave these parameters unused */
+#define __MUH_UNUSED __attribute__((unused))
+
+#define __MUH_CASE_DEFINITION(case_ident, ...)           \
     static muh_nit_case case_ident = {                   \
         #case_ident,                                     \
         __MUH_HLP_EVAL(__MUH_FIND_SKIP(__VA_ARGS__)),    \
         &case_ident##__inner_fun,                        \
         {MUH_UNINITIALIZED_ERROR},                       \
-        -1, /* stdout file descriptor */                 \
-        -1, /* stderr file descriptor */                 \
+        {NULL, 0, 0}, /* captured stdout */              \
+        {NULL, 0, 0}, /* captured stderr */              \
         __MUH_HLP_EVAL(__MUH_FIND_FIXTURE(__VA_ARGS__)), \
-    };                                                   \
-    void case_ident##__inner_fun(muh_error *__MUH_ERR_ARG, void *__MUH_FIX_DATA_ARG)
+        {NULL, 0, 0}, /* benchmark report */             \
+        0, NULL, 0,   /* durations */                    \
+    }
+
+#define MUH_NIT_CASE(case_ident, ...)                  \
+    void case_ident##__inner_fun(muh_error *, void *); \
+    __MUH_CASE_DEFINITION(case_ident, __VA_ARGS__);    \
+    void case_ident##__inner_fun(muh_error *__MUH_ERR_ARG __MUH_UNUSED, void *__MUH_FIX_DATA_ARG __MUH_UNUSED)
+
+#define __MUH_BENCH_ARG __muh_bench
+
+/*
+ * A case that times the body of its MUH_BENCH_LOOP when run with --bench
+ * and otherwise runs it once, like a test. With a table fixture, every row
+ * is measured and reported on its own.
+ */
+#define MUH_NIT_BENCH(case_ident, ...)                                                       \
+    void case_ident##__bench_fun(muh_error *, void *, muh_bench *);                          \
+    void case_ident##__inner_fun(muh_error *, void *);                                       \
+    __MUH_CASE_DEFINITION(case_ident, __VA_ARGS__);                                          \
+    void case_ident##__inner_fun(muh_error *__MUH_ERR_ARG, void *__MUH_FIX_DATA_ARG)         \
+    {                                                                                        \
+        muh_bench bench;                                                                     \
+        muh_bench_init(&bench);                                                              \
+        case_ident##__bench_fun(__MUH_ERR_ARG, __MUH_FIX_DATA_ARG, &bench);                  \
+        muh_bench_finish(&bench, __MUH_ERR_ARG, __MUH_FIX_DATA_ARG);                         \
+    }                                                                                        \
+    void case_ident##__bench_fun(muh_error *__MUH_ERR_ARG __MUH_UNUSED,                      \
+                                 void *__MUH_FIX_DATA_ARG __MUH_UNUSED,                      \
+                                 muh_bench *__MUH_BENCH_ARG)
+
+/* the statement after it is what gets timed; leave it by finishing, not with break */
+#define MUH_BENCH_LOOP                                                                 \
+    for (size_t __muh_batch; (__muh_batch = muh_bench_batch(__MUH_BENCH_ARG)) != 0;) \
+        for (; __muh_batch > 0; __muh_batch--)
+
+/* bytes processed per iteration, to report throughput */
+#define MUH_BENCH_BYTES(bytes) (__MUH_BENCH_ARG->bytes_per_op = (bytes))
+
+/* keeps the compiler from dropping a computation whose result is unused */
+#define MUH_DO_NOT_OPTIMIZE(value)                                  \
+    do                                                              \
+    {                                                               \
+        __typeof__(value) __muh_sink = (value);                     \
+        __asm__ volatile("" : : "r"(&__muh_sink) : "memory");       \
+    } while (0)
 
 #define MUH_ASSERT(message, assertion)     \
     do                                     \
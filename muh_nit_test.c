@@ -0,0 +1,57 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/* author: Matthias Meißner (geige.matze@gmail.com) */
+
+/*
+ * Cases that misbehave on purpose. `make test_runner` runs them with
+ * -j 2 --timeout 1 --json and checks that every one of them is reported
+ * and that the cases after a crash or a hang still run.
+ */
+
+#include "muh_nit.h"
+
+MUH_NIT_CASE(crashing_case)
+{
+    fputs("about to crash\n", stderr);
+    raise(SIGSEGV);
+}
+
+MUH_NIT_CASE(hanging_case)
+{
+    for (;;)
+        pause();
+}
+
+MUH_NIT_CASE(failing_case)
+{
+    printf("captured output\n");
+    MUH_FAIL("expected failure");
+}
+
+MUH_NIT_CASE(passing_case)
+{
+    MUH_ASSERT("arithmetic is broken", 1 + 1 == 2);
+}
+
+MUH_NIT_CASE(skipped_case, SKIP)
+{
+    MUH_FAIL("skipped cases must not run");
+}
+
+int main(int argc, const char **args)
+{
+    muh_nit_case cases[] = MUH_CASES(
+        crashing_case,
+        hanging_case,
+        failing_case,
+        passing_case,
+        skipped_case);
+
+    muh_setup(argc, args, cases);
+    muh_nit_run(cases);
+    return muh_nit_evaluate(cases);
+}
@@ -6,10 +6,15 @@
 
 /* author: Matthias Meißner (geige.matze@gmail.com) */
 
+#ifdef __cplusplus
+#include <utility>
+#endif
+
 #include "muh_nit.h"
 #include "cstr.h"
 
 #include "string.h"
+#include <ctype.h>
 
 MUH_NIT_CASE(test_cstr_from_char_ptr)
 {
@@ -53,6 +58,234 @@ MUH_NIT_CASE(test_cstring_append)
     cstring_free(s);
 }
 
+MUH_NIT_CASE(test_cstring_append_growth)
+{
+    cstring s = cstring_from("", malloc_wrapper);
+    size_t reallocs = 0, capacity = s.capacity;
+
+    for (int i = 0; i < 1000; i++)
+    {
+        cstring_append(&s, "ab");
+        if (s.capacity != capacity)
+            reallocs++;
+        capacity = s.capacity;
+    }
+
+    MUH_ASSERT("wrong length after appends", len(s) == 2000);
+    MUH_ASSERT("appends did not grow geometrically", reallocs < 20);
+    MUH_ASSERT("append corrupted content", strncmp(&s.inner[1996], "abab", 4) == 0);
+    cstring_free(s);
+}
+
+MUH_NIT_CASE(test_cstring_reserve_shrink_clear)
+{
+    cstring s = cstring_from("hello", malloc_wrapper);
+
+    cstring_reserve(&s, 100);
+    MUH_ASSERT("reserve did not grow", s.capacity >= 100);
+    MUH_ASSERT("reserve changed content", strncmp(s.inner, "hello", len(s)) == 0);
+
+    char *buffer = s.inner;
+    cstring_append(&s, " world");
+    MUH_ASSERT("append reallocated reserved string", s.inner == buffer);
+
+    cstring_shrink_to_fit(&s);
+    MUH_ASSERT("shrink did not fit", s.capacity == len(s));
+    MUH_ASSERT("shrink changed content", strncmp(s.inner, "hello world", len(s)) == 0);
+
+    cstring_clear(&s);
+    MUH_ASSERT("clear kept content", len(s) == 0);
+    MUH_ASSERT("clear dropped capacity", s.capacity == 11);
+
+    cstring_shrink_to_fit(&s);
+    MUH_ASSERT("shrink of empty string kept buffer", s.capacity == 0 && s.inner == NULL);
+    cstring_append(&s, "again");
+    MUH_ASSERT("append after shrink failed", strncmp(s.inner, "again", len(s)) == 0);
+    cstring_free(s);
+}
+
+MUH_NIT_CASE(test_arena_allocator)
+{
+    cstr_arena arena;
+    cstr_arena_init(&arena, 256);
+    allocator alloc = cstr_arena_allocator(&arena);
+
+    cstring a = cstring_from("hello", alloc);
+    cstring b = cstring_from("world", alloc);
+    MUH_ASSERT("arena allocation failed", strncmp(a.inner, "hello", len(a)) == 0);
+    MUH_ASSERT("arena allocations overlap", b.inner >= a.inner + a.capacity);
+
+    char *last = b.inner;
+    cstring_append(&b, " of arenas");
+    MUH_ASSERT("last allocation not grown in place", b.inner == last);
+
+    cstring_append(&a, " there");
+    MUH_ASSERT("grown allocation lost its content", strncmp(a.inner, "hello there", len(a)) == 0);
+    MUH_ASSERT("grown allocation overwritten", strncmp(b.inner, "world of arenas", len(b)) == 0);
+
+    for (int i = 0; i < 100; i++)
+        cstring_append(&a, "0123456789");
+    MUH_ASSERT("allocation spanning blocks failed", len(a) == 1011 && a.inner[1010] == '9');
+
+    cstr_arena_reset(&arena);
+    MUH_ASSERT("reset did not merge blocks", arena.blocks != NULL && arena.blocks->next == NULL);
+    MUH_ASSERT("reset did not free memory", arena.blocks->used == 0);
+
+    cstring c = cstring_from("after reset", alloc);
+    MUH_ASSERT("reset arena not reused", c.inner == CSTR_ARENA_DATA(arena.blocks) + CSTR_ARENA_HEADER);
+    cstring_free(c);
+    MUH_ASSERT("freeing the last allocation did not release it", arena.blocks->used == 0);
+
+    cstr_arena_free(&arena);
+}
+
+MUH_NIT_CASE(test_pool_allocator)
+{
+    cstr_pool_stats before = cstr_pool_get_stats();
+
+    cstring s = cstring_from("pooled", pool_allocator);
+    cstring_free(s);
+    cstring t = cstring_from("pooled again", pool_allocator);
+    MUH_ASSERT("freed block not reused", t.inner == s.inner);
+
+    cstr_pool_stats after = cstr_pool_get_stats();
+    MUH_ASSERT("reuse not counted as hit", after.hits == before.hits + 1);
+    MUH_ASSERT("first allocation not counted as miss", after.misses == before.misses + 1);
+
+    for (int i = 0; i < 10000; i++)
+        cstring_append(&t, "0123456789");
+    MUH_ASSERT("grown string lost content", strncmp(t.inner, "pooled again0123", 16) == 0);
+    MUH_ASSERT("grown string lost content", strncmp(&t.inner[len(t) - 10], "0123456789", 10) == 0);
+    MUH_ASSERT("large block not counted", cstr_pool_get_stats().oversized > after.oversized);
+
+    cstring_shrink_to_fit(&t);
+    MUH_ASSERT("shrunk string lost content", strncmp(&t.inner[len(t) - 10], "0123456789", 10) == 0);
+    cstring_free(t);
+}
+
+void *pool_worker(void *input)
+{
+    cstring *strings = (cstring *)input;
+
+    for (int round = 0; round < 100; round++)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            strings[i] = cstring_from("worker", pool_allocator);
+            for (int j = 0; j < i % 7; j++)
+                cstring_append(&strings[i], " string");
+        }
+        for (int i = 0; i < 100; i++)
+            cstring_free(strings[i]);
+    }
+
+    return NULL;
+}
+
+MUH_NIT_CASE(test_pool_allocator_threads)
+{
+    static cstring strings[4][100];
+    pthread_t threads[4];
+    cstr_pool_stats before = cstr_pool_get_stats();
+
+    for (int i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, &pool_worker, strings[i]);
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+
+    cstr_pool_stats after = cstr_pool_get_stats();
+    size_t requests = (after.hits - before.hits) + (after.misses - before.misses);
+    MUH_ASSERT("allocations from exited threads lost", requests >= 4 * 100 * 100);
+    MUH_ASSERT("thread caches not hit", after.hits - before.hits > after.misses - before.misses);
+}
+
+size_t counted_allocations;
+
+void *counting_run(void *context, void *ptr_to_free, size_t size)
+{
+    if (size != 0)
+        counted_allocations++;
+    return malloc_wrapper_run(context, ptr_to_free, size);
+}
+
+MUH_NIT_CASE(test_cstring_assign)
+{
+    allocator counting = {&counting_run, NULL};
+    cstring token = cstring_from("", counting);
+    cstr line = cstr("short tokens share one buffer until internationalization comes along");
+    counted_allocations = 0;
+
+    FOR_ITER_CSTR(word, line, " ")
+    {
+        cstring_assign(&token, word);
+        MUH_ASSERT("assign lost contents", cstr_match(cstr(token), word));
+    }
+
+    /* the first token allocates the minimum capacity, only the 20 byte one grows it */
+    MUH_ASSERT("assign did not reuse the buffer", counted_allocations == 2);
+
+    cstring copy = token;
+    MUH_ASSERT("copy does not see the contents", cstr_match(cstr(copy), cstr("along")));
+    cstring_free(token);
+}
+
+MUH_NIT_CASE(test_rope)
+{
+    cstr_rope rope = cstr_rope_new(malloc_wrapper);
+    cstring expected = cstring_from("", malloc_wrapper);
+    const char *referenced = "referenced, not copied";
+
+    for (int i = 0; i < 2000; i++)
+    {
+        cstr_rope_append(&rope, "0123456789abc");
+        cstring_append(&expected, "0123456789abc");
+
+        if (i % 500 == 0)
+        {
+            cstr_rope_append_ref(&rope, cstr(referenced));
+            cstring_append(&expected, referenced);
+        }
+    }
+
+    MUH_ASSERT("wrong rope length", rope.length == len(expected));
+
+    size_t chunks = 0, references = 0;
+    FOR_ITER_ROPE(chunk, rope)
+    {
+        chunks++;
+        if (ptr(chunk->data) == referenced)
+            references++;
+    }
+    MUH_ASSERT("wrong chunk count", chunks == rope.chunk_count);
+    MUH_ASSERT("referenced data copied", references == 4);
+
+    cstring flat = cstr_rope_flatten(&rope, malloc_wrapper);
+    MUH_ASSERT("flattened rope differs", cstr_match(cstr(flat), cstr(expected)));
+    MUH_ASSERT("flattened rope not exactly sized", flat.capacity == len(flat));
+
+    cstr_rope empty_rope = cstr_rope_new(malloc_wrapper);
+    cstr_rope_append(&empty_rope, "");
+    cstring nothing = cstr_rope_flatten(&empty_rope, malloc_wrapper);
+    MUH_ASSERT("flattened empty rope", len(nothing) == 0);
+    cstring_free(nothing);
+    cstr_rope_free(empty_rope);
+
+    FILE *file = tmpfile();
+    MUH_ASSERT("rope write failed", cstr_rope_write(&rope, fileno(file)));
+
+    char *buffer = (char *)malloc(len(expected));
+    lseek(fileno(file), 0, SEEK_SET);
+    MUH_ASSERT("wrong number of bytes written",
+               read(fileno(file), buffer, len(expected)) == (ssize_t)len(expected));
+    MUH_ASSERT("written rope differs", memcmp(buffer, ptr(expected), len(expected)) == 0);
+
+    free(buffer);
+    fclose(file);
+    cstring_free(flat);
+    cstring_free(expected);
+    cstr_rope_free(rope);
+}
+
 MUH_NIT_CASE(test_cstr_match)
 {
     cstr a = cstr("test"), b = cstr("test"), c = cstr("cccc"), d = cstr("d");
@@ -61,6 +294,181 @@ MUH_NIT_CASE(test_cstr_match)
     MUH_ASSERT("unequal strings match", !cstr_match(a, d));
 }
 
+MUH_NIT_CASE(test_cstr_match_long)
+{
+    char a[100], b[100];
+    for (size_t i = 0; i < sizeof(a); i++)
+        a[i] = b[i] = (char)('a' + i % 26);
+
+    for (size_t length = 0; length <= sizeof(a); length++)
+    {
+        MUH_ASSERT("equal strings do not match", cstr_match((cstr){length, a}, (cstr){length, b}));
+
+        for (size_t i = 0; i < length; i++)
+        {
+            b[i] = '#';
+            MUH_ASSERT("unequal strings match", !cstr_match((cstr){length, a}, (cstr){length, b}));
+            MUH_ASSERT("wrong mismatch position", cstr_mismatch(a, b, length) == i);
+            b[i] = a[i];
+        }
+    }
+}
+
+MUH_NIT_CASE(test_cstr_compare)
+{
+    MUH_ASSERT("equal strings not equal", cstr_compare(cstr("abc"), cstr("abc")) == 0);
+    MUH_ASSERT("wrong order", cstr_compare(cstr("abc"), cstr("abd")) < 0);
+    MUH_ASSERT("wrong order", cstr_compare(cstr("abd"), cstr("abc")) > 0);
+    MUH_ASSERT("prefix not first", cstr_compare(cstr("ab"), cstr("abc")) < 0);
+    MUH_ASSERT("prefix not first", cstr_compare(cstr("abc"), cstr("ab")) > 0);
+    MUH_ASSERT("bytes compared signed", cstr_compare(cstr("a\xff"), cstr("a\x01")) > 0);
+    MUH_ASSERT("long strings in wrong order",
+               cstr_compare(cstr("0123456789abcdef0123456789abcdeX"),
+                            cstr("0123456789abcdef0123456789abcdeY")) < 0);
+}
+
+MUH_NIT_CASE(test_cstr_starts_ends_with)
+{
+    cstr s = cstr("prefix-body-suffix");
+    MUH_ASSERT("prefix not found", cstr_starts_with(s, cstr("prefix")));
+    MUH_ASSERT("fake prefix", !cstr_starts_with(s, cstr("body")));
+    MUH_ASSERT("empty prefix not found", cstr_starts_with(s, cstr("")));
+    MUH_ASSERT("suffix not found", cstr_ends_with(s, cstr("-suffix")));
+    MUH_ASSERT("fake suffix", !cstr_ends_with(s, cstr("prefix")));
+    MUH_ASSERT("overlong suffix found", !cstr_ends_with(cstr("fix"), cstr("suffix")));
+}
+
+MUH_NIT_CASE(test_cstr_match_ignore_case)
+{
+    MUH_ASSERT("case differences matter",
+               cstr_match_ignore_case(cstr("Content-Type: TEXT/html; charset=UTF-8"),
+                                      cstr("content-type: text/HTML; CHARSET=utf-8")));
+    MUH_ASSERT("unequal strings match",
+               !cstr_match_ignore_case(cstr("Content-Type: text/html; charset=UTF-8"),
+                                       cstr("content-type: text/html; charset=UTF-9")));
+    MUH_ASSERT("non letters folded", !cstr_match_ignore_case(cstr("@[`{"), cstr("`{@[")));
+    MUH_ASSERT("non letters folded",
+               !cstr_match_ignore_case(cstr("@@@@@@@@@@@@@@@@@@"), cstr("``````````````````")));
+    MUH_ASSERT("short strings not folded", cstr_match_ignore_case(cstr("aBc"), cstr("AbC")));
+}
+
+MUH_NIT_CASE(test_cstr_hash)
+{
+    char buffer[100];
+    memset(buffer, 'x', sizeof(buffer));
+
+    MUH_ASSERT("hash not deterministic", cstr_hash(cstr("key")) == cstr_hash(cstr("key")));
+    MUH_ASSERT("hash ignores content", cstr_hash(cstr("key1")) != cstr_hash(cstr("key2")));
+    MUH_ASSERT("seed ignored", cstr_hash_seeded(cstr("key"), 1) != cstr_hash_seeded(cstr("key"), 2));
+
+    for (size_t length = 1; length < sizeof(buffer); length++)
+        MUH_ASSERT("hash ignores length",
+                   cstr_hash((cstr){length, buffer}) != cstr_hash((cstr){length - 1, buffer}));
+}
+
+MUH_NIT_CASE(test_cstr_map)
+{
+    static char keys[1000][8];
+    cstr_map map = cstr_map_new(malloc_wrapper);
+
+    for (size_t i = 0; i < 1000; i++)
+    {
+        sprintf(keys[i], "key%zu", i);
+        MUH_ASSERT("fresh key not new", cstr_map_insert(&map, cstr(keys[i]), &keys[i]));
+    }
+
+    MUH_ASSERT("wrong count", map.count == 1000);
+    MUH_ASSERT("load factor too high", 4 * map.count <= 3 * map.capacity);
+    MUH_ASSERT("existing key new", !cstr_map_insert(&map, cstr("key7"), NULL));
+    MUH_ASSERT("value not replaced", *cstr_map_get(&map, cstr("key7")) == NULL);
+    MUH_ASSERT("missing key found", cstr_map_get(&map, cstr("key1000")) == NULL);
+
+    for (size_t i = 0; i < 1000; i += 2)
+        MUH_ASSERT("remove failed", cstr_map_remove(&map, cstr(keys[i])));
+    MUH_ASSERT("removed twice", !cstr_map_remove(&map, cstr(keys[0])));
+
+    for (size_t i = 0; i < 1000; i++)
+    {
+        void **value = cstr_map_get(&map, cstr(keys[i]));
+        if (i % 2 == 0)
+            MUH_ASSERT("removed key found", value == NULL);
+        else if (i != 7)
+            MUH_ASSERT("key lost after removals", value != NULL && *value == &keys[i]);
+    }
+
+    MUH_ASSERT("wrong count after removals", map.count == 500);
+    cstr_map_free(map);
+}
+
+MUH_NIT_CASE(test_interner)
+{
+    cstr_interner interner;
+    cstr_interner_init(&interner);
+    char buffer[] = "label";
+
+    cstr a = cstr_intern(&interner, cstr("label"));
+    cstr b = cstr_intern(&interner, cstr(buffer));
+    cstr c = cstr_intern(&interner, cstr("other"));
+    MUH_ASSERT("interned strings not canonical", ptr(a) == ptr(b));
+    MUH_ASSERT("different strings share storage", ptr(a) != ptr(c));
+    MUH_ASSERT("interned string not copied", ptr(b) != buffer && cstr_match(b, cstr("label")));
+
+    size_t id = cstr_intern_id(&interner, cstr("other"));
+    MUH_ASSERT("id does not round trip", ptr(cstr_interner_lookup(&interner, id)) == ptr(c));
+    MUH_ASSERT("unknown id found", ptr(cstr_interner_lookup(&interner, id + (1 << 20))) == NULL);
+
+    cstr_interner_stats stats = cstr_interner_get_stats(&interner);
+    MUH_ASSERT("wrong number of strings", stats.strings == 2);
+    MUH_ASSERT("wrong string bytes", stats.string_bytes == 10);
+    MUH_ASSERT("allocation not reported", stats.allocated_bytes >= stats.string_bytes);
+
+    cstr_interner_free(&interner);
+}
+
+typedef struct intern_worker_data
+{
+    cstr_interner *interner;
+    const char *results[200];
+} intern_worker_data;
+
+void *intern_worker(void *input)
+{
+    intern_worker_data *data = (intern_worker_data *)input;
+    char buffer[16];
+
+    for (int round = 0; round < 10; round++)
+        for (int i = 0; i < 200; i++)
+        {
+            sprintf(buffer, "label-%d", i);
+            data->results[i] = ptr(cstr_intern(data->interner, cstr(buffer)));
+        }
+
+    return NULL;
+}
+
+MUH_NIT_CASE(test_interner_threads)
+{
+    static intern_worker_data data[4];
+    cstr_interner interner;
+    pthread_t threads[4];
+    cstr_interner_init(&interner);
+
+    for (int i = 0; i < 4; i++)
+    {
+        data[i].interner = &interner;
+        pthread_create(&threads[i], NULL, &intern_worker, &data[i]);
+    }
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < 200; i++)
+        for (int t = 1; t < 4; t++)
+            MUH_ASSERT("threads got different copies", data[t].results[i] == data[0].results[i]);
+
+    MUH_ASSERT("strings interned twice", cstr_interner_get_stats(&interner).strings == 200);
+    cstr_interner_free(&interner);
+}
+
 MUH_NIT_CASE(test_find_first)
 {
     cstr a = cstr("tesettingsre");
@@ -68,6 +476,129 @@ MUH_NIT_CASE(test_find_first)
     MUH_ASSERT("find failed", cstr_match(cstr_find_first(a, cstr("setting")), cstr("setting")));
 }
 
+MUH_NIT_CASE(test_find_first_matches_kmp)
+{
+    char haystack[300];
+    char needle[80];
+
+    for (size_t i = 0; i < sizeof(haystack); i++)
+        haystack[i] = "ab"[(i * 7 + i / 13) % 3 == 0];
+
+    for (size_t needle_len = 1; needle_len < sizeof(needle); needle_len++)
+        for (size_t offset = 0; offset + needle_len <= sizeof(haystack); offset += 37)
+        {
+            memcpy(needle, &haystack[offset], needle_len);
+            cstr hay = {sizeof(haystack), haystack}, pat = {needle_len, needle};
+
+            cstr expected = cstr_find_first_kmp(hay, pat);
+            cstr found = cstr_find_first(hay, pat);
+            MUH_ASSERT("find_first differs from kmp", ptr(found) == ptr(expected));
+            MUH_ASSERT("find_first differs from kmp", len(found) == len(expected));
+
+            needle[needle_len - 1] = 'c';
+            found = cstr_find_first(hay, pat);
+            MUH_ASSERT("fake finding", len(found) == 0 && ptr(found) == end(hay));
+        }
+}
+
+MUH_NIT_CASE(test_pattern_find_first)
+{
+    cstr a = cstr("tesettingsre");
+    cstr_pattern test = cstr_pattern_compile(cstr("test"));
+    cstr_pattern setting = cstr_pattern_compile(cstr("setting"));
+    cstr_pattern s = cstr_pattern_compile(cstr("s"));
+    cstr_pattern empty = cstr_pattern_compile(cstr(""));
+
+    MUH_ASSERT("fake finding", len(cstr_pattern_find_first(&test, a)) == 0);
+    MUH_ASSERT("find failed", ptr(cstr_pattern_find_first(&setting, a)) == ptr(a) + 2);
+    MUH_ASSERT("find failed", ptr(cstr_pattern_find_first(&s, a)) == ptr(a) + 2);
+    MUH_ASSERT("contains found fake", !cstr_pattern_contains(&test, a));
+    MUH_ASSERT("contains found not", cstr_pattern_contains(&setting, a));
+    MUH_ASSERT("empty pattern not contained", cstr_pattern_contains(&empty, a));
+}
+
+MUH_NIT_CASE(test_pattern_horspool)
+{
+    cstr a = cstr("abracadabra, abrakadabra");
+    cstr_pattern pattern = cstr_pattern_compile(cstr("kadab"));
+    pattern.kind = cstr_search_horspool;
+
+    MUH_ASSERT("find failed", ptr(cstr_pattern_find_first(&pattern, a)) == ptr(a) + 17);
+
+    pattern = cstr_pattern_compile(cstr("cadabrx"));
+    pattern.kind = cstr_search_horspool;
+    MUH_ASSERT("fake finding", len(cstr_pattern_find_first(&pattern, a)) == 0);
+}
+
+MUH_NIT_CASE(test_pattern_find_all)
+{
+    cstr a = cstr("aaaaa-ab-aaa");
+    cstr_pattern pattern = cstr_pattern_compile(cstr("aa"));
+    cstr matches[2];
+
+    MUH_ASSERT("wrong count", cstr_pattern_count(&pattern, a) == 3);
+    MUH_ASSERT("wrong number of matches", cstr_pattern_find_all(&pattern, a, matches, 2) == 3);
+    MUH_ASSERT("wrong first match", ptr(matches[0]) == ptr(a));
+    MUH_ASSERT("matches overlap", ptr(matches[1]) == ptr(a) + 2);
+}
+
+MUH_NIT_CASE(test_multi_pattern)
+{
+    cstr needles[] = {cstr("he"), cstr("she"), cstr("his"), cstr("hers"), cstr("")};
+    cstr_multi_pattern pattern = cstr_multi_pattern_compile(needles, 5, malloc_wrapper);
+    cstr_multi_match matches[8];
+    cstr_multi_match first;
+
+    MUH_ASSERT("match not found", cstr_multi_pattern_contains(&pattern, cstr("hi there")));
+    MUH_ASSERT("found fake match", !cstr_multi_pattern_contains(&pattern, cstr("xyz")));
+    MUH_ASSERT("first match not found", cstr_multi_pattern_find_first(&pattern, cstr("ushers"), &first));
+    MUH_ASSERT("wrong first match", first.needle_index == 1 && first.offset == 1);
+
+    size_t count = cstr_multi_pattern_find_all(&pattern, cstr("ushers"), matches, 8);
+    MUH_ASSERT("wrong number of matches", count == 3);
+    MUH_ASSERT("wrong match", matches[0].needle_index == 1 && matches[0].offset == 1);
+    MUH_ASSERT("wrong match", matches[1].needle_index == 0 && matches[1].offset == 2);
+    MUH_ASSERT("wrong match", matches[2].needle_index == 3 && matches[2].offset == 2);
+
+    cstr_multi_pattern_free(pattern);
+}
+
+MUH_NIT_CASE(test_multi_pattern_matches_contains)
+{
+    char haystack[512];
+    cstr needles[40];
+
+    for (size_t i = 0; i < sizeof(haystack); i++)
+        haystack[i] = "abcd"[(i * i + i / 3) % 4];
+
+    for (size_t n = 0; n < 40; n++)
+        needles[n] = (cstr){1 + n % 7, &haystack[(n * 97) % 400]};
+    needles[39] = cstr("dddddddd");
+
+    cstr hay = {sizeof(haystack), haystack};
+    cstr_multi_pattern pattern = cstr_multi_pattern_compile(needles, 40, malloc_wrapper);
+    cstr_multi_match matches[4096];
+    size_t count = cstr_multi_pattern_find_all(&pattern, hay, matches, 4096);
+    size_t expected = 0;
+
+    for (size_t n = 0; n < 40; n++)
+        for (size_t i = 0; i + len(needles[n]) <= sizeof(haystack); i++)
+            if (memcmp(&haystack[i], ptr(needles[n]), len(needles[n])) == 0)
+                expected++;
+
+    MUH_ASSERT("match overflow", count <= 4096);
+    MUH_ASSERT("wrong number of matches", count == expected);
+
+    for (size_t m = 0; m < count; m++)
+    {
+        cstr needle = needles[matches[m].needle_index];
+        MUH_ASSERT("reported match does not match",
+                   memcmp(&haystack[matches[m].offset], ptr(needle), len(needle)) == 0);
+    }
+
+    cstr_multi_pattern_free(pattern);
+}
+
 MUH_NIT_CASE(test_contains)
 {
     cstr a = cstr("tesettingsere");
@@ -124,6 +655,644 @@ MUH_NIT_CASE(test_for_word_sep)
     MUH_ASSERT("skipped words", i == 5);
 }
 
+MUH_NIT_CASE(test_split_matches_for_iter)
+{
+    const char *inputs[] = {"a--b----c--", "--lead", "none", "", "x--"};
+
+    for (size_t n = 0; n < sizeof(inputs) / sizeof(*inputs); n++)
+    {
+        cstr input = cstr(inputs[n]);
+        cstr_split split = cstr_split_on(input, cstr("--"));
+        cstr token;
+
+        FOR_ITER_CSTR(word, input, "--")
+        {
+            MUH_ASSERT("split ended early", cstr_split_next(&split, &token));
+            MUH_ASSERT("split token differs", ptr(token) == ptr(word) && len(token) == len(word));
+        }
+
+        MUH_ASSERT("split yields extra tokens", !cstr_split_next(&split, &token));
+    }
+}
+
+MUH_NIT_CASE(test_split_byte)
+{
+    cstr line = cstr("name,,value,");
+    cstr_split split = cstr_split_on_byte(line, ',');
+    cstr token;
+
+    MUH_ASSERT("first field missing", cstr_split_next(&split, &token));
+    MUH_ASSERT("wrong first field", cstr_match(token, cstr("name")));
+    MUH_ASSERT("wrong remaining input", cstr_match(cstr_split_remaining(&split), cstr(",value,")));
+    MUH_ASSERT("empty field missing", cstr_split_next(&split, &token) && len(token) == 0);
+    MUH_ASSERT("last field missing", cstr_split_next(&split, &token));
+    MUH_ASSERT("wrong last field", cstr_match(token, cstr("value")));
+    MUH_ASSERT("split yields extra tokens", !cstr_split_next(&split, &token));
+}
+
+MUH_NIT_CASE(test_split_set)
+{
+    char input[100];
+    for (size_t i = 0; i < sizeof(input); i++)
+        input[i] = i % 10 == 9 ? "\t;,"[i % 3] : 'a';
+
+    cstr_split split = cstr_split_on_any((cstr){sizeof(input), input}, cstr(",;\t"));
+    cstr token;
+    size_t tokens = 0;
+
+    while (cstr_split_next(&split, &token))
+    {
+        MUH_ASSERT("wrong token position", ptr(token) == &input[tokens * 10]);
+        MUH_ASSERT("wrong token length", len(token) == 9);
+        tokens++;
+    }
+
+    MUH_ASSERT("wrong number of tokens", tokens == 10);
+}
+
+MUH_NIT_CASE(test_mmap_file)
+{
+    char path[] = "/tmp/cstr_mmap_XXXXXX";
+    int fd = mkstemp(path);
+    const char *text = "first line\nsecond line\n\nlast line";
+    MUH_ASSERT("could not create file", fd >= 0);
+    MUH_ASSERT("could not write file", write(fd, text, strlen(text)) == (ssize_t)strlen(text));
+    close(fd);
+
+    cstr_file_mapping file;
+    MUH_ASSERT("mapping failed", cstr_mmap_file(path, cstr_mmap_sequential, &file));
+    MUH_ASSERT("mapping differs from file", cstr_match(file.contents, cstr(text)));
+
+    int lines = 0;
+    FOR_ITER_CSTR(line, file.contents, "\n")
+    {
+        lines++;
+        if (lines == 4)
+            MUH_ASSERT("wrong last line", cstr_match(line, cstr("last line")));
+    }
+    MUH_ASSERT("wrong number of lines", lines == 4);
+    cstr_munmap_file(file);
+
+    fd = open(path, O_WRONLY | O_TRUNC);
+    close(fd);
+    MUH_ASSERT("mapping empty file failed", cstr_mmap_file(path, cstr_mmap_normal, &file));
+    MUH_ASSERT("empty file not empty", len(file.contents) == 0);
+    cstr_munmap_file(file);
+
+    unlink(path);
+    MUH_ASSERT("missing file mapped", !cstr_mmap_file(path, cstr_mmap_normal, &file));
+
+    errno = 0;
+    MUH_ASSERT("proc file mapped", !cstr_mmap_file("/proc/self/status", cstr_mmap_normal, &file));
+    MUH_ASSERT("wrong errno for proc file", errno == ENODEV);
+
+    MUH_ASSERT("could not create fifo", mkfifo(path, 0600) == 0);
+    errno = 0;
+    bool mapped_fifo = cstr_mmap_file(path, cstr_mmap_normal, &file);
+    unlink(path);
+    MUH_ASSERT("fifo mapped", !mapped_fifo);
+    MUH_ASSERT("wrong errno for fifo", errno == ENODEV);
+}
+
+MUH_NIT_CASE(test_reader)
+{
+    char path[] = "/tmp/cstr_reader_XXXXXX";
+    int fd = mkstemp(path);
+    MUH_ASSERT("could not create file", fd >= 0);
+    unlink(path);
+
+    /* lines of growing length, the last one is longer than the initial buffer */
+    cstring expected = cstring_from("", malloc_wrapper);
+    size_t line_count = 0;
+    for (size_t length = 0; length < 3 * CSTR_READER_BUFFER_SIZE; length = length * 2 + 7, line_count++)
+    {
+        cstring_reserve(&expected, expected.length + length + 1);
+        for (size_t i = 0; i < length; i++)
+            expected.inner[expected.length++] = (char)('a' + (line_count + i) % 26);
+        expected.inner[expected.length++] = '\n';
+    }
+    cstring_append(&expected, "no trailing delimiter");
+    line_count++;
+
+    MUH_ASSERT("could not write file", write(fd, expected.inner, expected.length) == (ssize_t)expected.length);
+    lseek(fd, 0, SEEK_SET);
+
+    cstr_reader reader = cstr_reader_new(fd, '\n', malloc_wrapper);
+    cstr record;
+    size_t records = 0;
+    cstr_split lines = cstr_split_on_byte(cstr(expected), '\n');
+    cstr line;
+
+    while (cstr_reader_next(&reader, &record))
+    {
+        MUH_ASSERT("more records than lines", cstr_split_next(&lines, &line));
+        MUH_ASSERT("record differs", cstr_match(record, line));
+        records++;
+    }
+
+    MUH_ASSERT("read error", reader.error == 0);
+    MUH_ASSERT("wrong number of records", records == line_count);
+    MUH_ASSERT("record contains works on last record", cstr_contains(record, cstr("trailing")));
+
+    cstr_reader_free(reader);
+    cstring_free(expected);
+    close(fd);
+}
+
+MUH_NIT_CASE(test_parallel_search)
+{
+    const size_t length = 3 * CSTR_PARALLEL_CHUNK_SIZE + 12345;
+    char *text = (char *)malloc(length);
+    uint32_t state = 12345;
+
+    /* mostly 'a', so overlapping needles produce matches across every chunk border */
+    for (size_t i = 0; i < length; i++)
+    {
+        state = state * 1103515245 + 12345;
+        text[i] = (state >> 16) % 16 == 0 ? 'b' : 'a';
+    }
+    memcpy(text + 2 * CSTR_PARALLEL_CHUNK_SIZE - 3, "unique", 6);
+
+    cstr haystack = {length, text};
+    const char *needles[] = {"unique", "aaa", "aaaaaaaaaaaaaaaaaaaaaaab", "abab", "ba", "not there"};
+    const size_t thread_counts[] = {1, 2, 3, 8};
+    size_t max_matches = length;
+    cstr *expected = (cstr *)malloc(max_matches * sizeof(cstr));
+    cstr *found = (cstr *)malloc(max_matches * sizeof(cstr));
+
+    for (size_t n = 0; n < sizeof(needles) / sizeof(*needles); n++)
+    {
+        cstr_pattern pattern = cstr_pattern_compile(cstr(needles[n]));
+        cstr first = cstr_pattern_find_first(&pattern, haystack);
+        size_t count = cstr_pattern_find_all(&pattern, haystack, expected, max_matches);
+
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(*thread_counts); t++)
+        {
+            cstr parallel_first = cstr_pattern_find_first_parallel(&pattern, haystack, thread_counts[t]);
+            MUH_ASSERT("first match differs",
+                       ptr(parallel_first) == ptr(first) && len(parallel_first) == len(first));
+            MUH_ASSERT("count differs",
+                       cstr_pattern_count_parallel(&pattern, haystack, thread_counts[t]) == count);
+            MUH_ASSERT("find_all count differs",
+                       cstr_pattern_find_all_parallel(&pattern, haystack, thread_counts[t],
+                                                      found, max_matches) == count);
+
+            for (size_t i = 0; i < count; i++)
+                MUH_ASSERT("match differs", ptr(found[i]) == ptr(expected[i]));
+
+            MUH_ASSERT("truncated find_all count differs",
+                       cstr_pattern_find_all_parallel(&pattern, haystack, thread_counts[t], found, 1) == count);
+            MUH_ASSERT("truncated match differs", count == 0 || ptr(found[0]) == ptr(expected[0]));
+        }
+    }
+
+    free(found);
+    free(expected);
+    free(text);
+}
+
+MUH_NIT_CASE(test_parse_integers)
+{
+    uint64_t u;
+    int64_t i;
+
+    MUH_ASSERT("zero", cstr_parse_u64(cstr("0"), &u) && u == 0);
+    MUH_ASSERT("sixteen digits", cstr_parse_u64(cstr("1234567890123456"), &u) && u == 1234567890123456ull);
+    MUH_ASSERT("u64 max", cstr_parse_u64(cstr("18446744073709551615"), &u) && u == UINT64_MAX);
+    MUH_ASSERT("leading zeros", cstr_parse_u64(cstr("+0000000000000000000000042"), &u) && u == 42);
+    MUH_ASSERT("u64 overflow", !cstr_parse_u64(cstr("18446744073709551616"), &u));
+    MUH_ASSERT("too many digits", !cstr_parse_u64(cstr("123456789012345678901"), &u));
+    MUH_ASSERT("empty", !cstr_parse_u64(cstr(""), &u));
+    MUH_ASSERT("sign only", !cstr_parse_u64(cstr("+"), &u));
+    MUH_ASSERT("negative u64", !cstr_parse_u64(cstr("-1"), &u));
+    MUH_ASSERT("non digit in swar block", !cstr_parse_u64(cstr("1234:678"), &u));
+    MUH_ASSERT("trailing garbage", !cstr_parse_u64(cstr("12345678x"), &u));
+
+    MUH_ASSERT("i64 min", cstr_parse_i64(cstr("-9223372036854775808"), &i) && i == INT64_MIN);
+    MUH_ASSERT("i64 max", cstr_parse_i64(cstr("9223372036854775807"), &i) && i == INT64_MAX);
+    MUH_ASSERT("i64 overflow", !cstr_parse_i64(cstr("9223372036854775808"), &i));
+    MUH_ASSERT("i64 underflow", !cstr_parse_i64(cstr("-9223372036854775809"), &i));
+    MUH_ASSERT("double sign", !cstr_parse_i64(cstr("-+1"), &i));
+    MUH_ASSERT("minus only", !cstr_parse_i64(cstr("-"), &i));
+
+    /* tokens from FOR_ITER_CSTR are not terminated */
+    int64_t sum = 0;
+    cstr tokens = cstr("12,-7,123456789012,0");
+    FOR_ITER_CSTR(token, tokens, ",")
+    {
+        MUH_ASSERT("token not parsed", cstr_parse_i64(token, &i));
+        sum += i;
+    }
+    MUH_ASSERT("wrong sum", sum == 123456789017);
+
+    uint32_t state = 1;
+    for (int n = 0; n < 100000; n++)
+    {
+        state = state * 1103515245 + 12345;
+        int64_t expected = (int64_t)((uint64_t)state << 32 | (state * 2654435761u)) >> (state % 60);
+        cstring formatted = cstring_from("", malloc_wrapper);
+
+        cstring_append_i64(&formatted, expected);
+        cstring_reserve(&formatted, formatted.length + 1);
+        formatted.inner[formatted.length] = '\0';
+        MUH_ASSERT("format differs from strtoll", strtoll(formatted.inner, NULL, 10) == expected);
+        MUH_ASSERT("round trip failed", cstr_parse_i64(cstr(formatted), &i) && i == expected);
+
+        cstring_free(formatted);
+    }
+}
+
+MUH_NIT_CASE(test_parse_float)
+{
+    double d;
+    const char *valid[] = {"0", "-0", "1.5", "+.5", "5.", "3.14159", "1e10", "1E-5", "-2.5e+3",
+                           "0.1", "123456789012345678901234567890", "1e308", "1e-320", "4.9e-324",
+                           "2.2250738585072014e-308", "0.000000000000000000000000000001",
+                           "9007199254740993", "1.7976931348623157e308", "00000.00001e5"};
+    const char *invalid[] = {"", "-", ".", "e5", "1e", "1e+", "1.2.3", "0x10", " 1", "1 ", "1f", "--1",
+                             "1e400", "-1.8e308", "1,5"};
+
+    for (size_t n = 0; n < sizeof(valid) / sizeof(*valid); n++)
+    {
+        double expected = strtod(valid[n], NULL);
+        MUH_ASSERT("differs from strtod", cstr_parse_f64(cstr(valid[n]), &d) &&
+                                               memcmp(&d, &expected, sizeof(d)) == 0);
+    }
+
+    for (size_t n = 0; n < sizeof(invalid) / sizeof(*invalid); n++)
+        MUH_ASSERT("invalid input parsed", !cstr_parse_f64(cstr(invalid[n]), &d));
+
+    MUH_ASSERT("inf", cstr_parse_f64(cstr("-Infinity"), &d) && isinf(d) && d < 0);
+    MUH_ASSERT("nan", cstr_parse_f64(cstr("NaN"), &d) && isnan(d));
+
+    const char *formatted[][2] = {{"0.1", "0.1"}, {"-0", "-0"}, {"3", "3"}, {"1234.5", "1234.5"},
+                                  {"0.00001", "0.00001"}, {"1e300", "1e+300"}, {"-inf", "-inf"},
+                                  {"0.30000000000000004", "0.30000000000000004"}, {"5e-324", "5e-324"},
+                                  {"1e23", "1e+23"}, {"1.7976931348623157e308", "1.7976931348623157e+308"},
+                                  {"123456789012345678", "1.2345678901234568e+17"},
+                                  {"1e16", "10000000000000000"}, {"2.5e-300", "2.5e-300"}};
+
+    for (size_t n = 0; n < sizeof(formatted) / sizeof(*formatted); n++)
+    {
+        cstring string = cstring_from("", malloc_wrapper);
+        cstr_parse_f64(cstr(formatted[n][0]), &d);
+        cstring_append_f64(&string, d);
+        MUH_ASSERT("wrong format", cstr_match(cstr(string), cstr(formatted[n][1])));
+        cstring_free(string);
+    }
+
+    /* the strtod and printf fallbacks must not pick up a ',' decimal point */
+    const char *numeric = setlocale(LC_NUMERIC, NULL);
+    char saved_numeric[64];
+    snprintf(saved_numeric, sizeof(saved_numeric), "%s", numeric != NULL ? numeric : "C");
+
+    if (setlocale(LC_NUMERIC, "de_DE.UTF-8") != NULL || setlocale(LC_NUMERIC, "fr_FR.UTF-8") != NULL)
+    {
+        cstring string = cstring_from("", malloc_wrapper);
+        MUH_ASSERT("locale parse", cstr_parse_f64(cstr("0.1234567890123456789"), &d) && d > 0.12 && d < 0.13);
+        cstring_append_f64(&string, 1.0 / 3.0);
+        MUH_ASSERT("locale format", cstr_match(cstr(string), cstr("0.3333333333333333")));
+        cstring_free(string);
+        setlocale(LC_NUMERIC, saved_numeric);
+    }
+
+    uint64_t state = 88172645463325252ull;
+    for (int n = 0; n < 100000; n++)
+    {
+        state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+        double expected;
+        uint64_t bits = n % 2 == 0 ? state : state % 1000000;
+        if (n % 2 == 0)
+            memcpy(&expected, &bits, sizeof(expected));
+        else
+            expected = (double)bits / 1000;
+
+        if (isnan(expected))
+            continue;
+
+        cstring string = cstring_from("", malloc_wrapper);
+        cstring_append_f64(&string, expected);
+        MUH_ASSERT("float round trip failed", cstr_parse_f64(cstr(string), &d) &&
+                                                  memcmp(&d, &expected, sizeof(d)) == 0);
+        cstring_free(string);
+    }
+}
+
+MUH_NIT_CASE(test_utf8)
+{
+    const char *valid[] = {"", "plain ascii", "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80",
+                           "\xEF\xBB\xBF", "\xF4\x8F\xBF\xBF", "\xED\x9F\xBF", "\xC2\x80"};
+    const char *invalid[] = {"\x80", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF",
+                             "\xED\xA0\x80", "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80",
+                             "\xC3", "\xE2\x82", "\xF0\x9F\x98", "\xC3\xA9\xA9", "\xFF"};
+    char buffer[96];
+
+    /* at every offset, so sequences straddle the vector blocks */
+    for (size_t offset = 0; offset < 64; offset++)
+    {
+        memset(buffer, 'x', sizeof(buffer));
+
+        for (size_t n = 0; n < sizeof(valid) / sizeof(*valid); n++)
+        {
+            memcpy(buffer + offset, valid[n], strlen(valid[n]));
+            MUH_ASSERT("valid input rejected", cstr_utf8_validate((cstr){sizeof(buffer), buffer}));
+            memset(buffer + offset, 'x', strlen(valid[n]));
+        }
+
+        for (size_t n = 0; n < sizeof(invalid) / sizeof(*invalid); n++)
+        {
+            memcpy(buffer + offset, invalid[n], strlen(invalid[n]));
+            MUH_ASSERT("invalid input accepted", !cstr_utf8_validate((cstr){sizeof(buffer), buffer}));
+            MUH_ASSERT("truncated input accepted",
+                       !cstr_utf8_validate((cstr){offset + strlen(invalid[n]), buffer}) ||
+                           invalid[n][strlen(invalid[n]) - 1] == '\xA9');
+            memset(buffer + offset, 'x', strlen(invalid[n]));
+        }
+    }
+
+    /* random inputs, mostly made of valid sequences, against the scalar decoder */
+    uint32_t state = 7;
+    for (int n = 0; n < 20000; n++)
+    {
+        size_t length = 0;
+        while (length + 10 <= sizeof(buffer))
+        {
+            state = state * 1103515245 + 12345;
+            const char *piece = valid[2 + (state >> 16) % 5];
+            memcpy(buffer + length, piece, strlen(piece));
+            length += strlen(piece);
+        }
+
+        state = state * 1103515245 + 12345;
+        if (state % 4 != 0)
+            buffer[(state >> 8) % length] = (char)(state >> 20);
+
+        cstr input = {length, buffer};
+        MUH_ASSERT("validation differs from scalar",
+                   cstr_utf8_validate(input) ==
+                       cstr_utf8_validate_scalar((const unsigned char *)buffer, length, 0));
+    }
+
+    cstr text = cstr("a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80!");
+    const uint32_t expected[] = {'a', 0xE9, 0x20AC, 0x1F600, '!'};
+    size_t count = 0;
+
+    FOR_ITER_UTF8(code_point, text)
+    {
+        MUH_ASSERT("too many code points", count < 5);
+        MUH_ASSERT("wrong code point", code_point == expected[count]);
+        count++;
+    }
+    MUH_ASSERT("wrong code point count", count == 5 && cstr_utf8_length(text) == 5);
+
+    cstr broken = cstr("a\xE2\x82z");
+    uint32_t code_point;
+    cstr_utf8_iter iter = cstr_utf8_iter_new(broken);
+    MUH_ASSERT("expected a", cstr_utf8_next(&iter, &code_point) && code_point == 'a');
+    MUH_ASSERT("expected replacement", cstr_utf8_next(&iter, &code_point) && code_point == 0xFFFD);
+    MUH_ASSERT("expected replacement", cstr_utf8_next(&iter, &code_point) && code_point == 0xFFFD);
+    MUH_ASSERT("expected z", cstr_utf8_next(&iter, &code_point) && code_point == 'z');
+    MUH_ASSERT("expected end", !cstr_utf8_next(&iter, &code_point));
+
+    cstring long_text = cstring_from("", malloc_wrapper);
+    for (int i = 0; i < 50; i++)
+        cstring_append(&long_text, "ascii only ");
+    MUH_ASSERT("ascii not detected", cstr_is_ascii(cstr(long_text)));
+    MUH_ASSERT("ascii length", cstr_utf8_length(cstr(long_text)) == long_text.length);
+    cstring_append(&long_text, text);
+    MUH_ASSERT("non ascii not detected", !cstr_is_ascii(cstr(long_text)));
+    MUH_ASSERT("mixed length", cstr_utf8_length(cstr(long_text)) == long_text.length - len(text) + 5);
+    cstring_free(long_text);
+}
+
+MUH_NIT_CASE(test_trim)
+{
+    MUH_ASSERT("trim", cstr_match(cstr_trim(cstr(" \t\r\n word  word \v\f")), cstr("word  word")));
+    MUH_ASSERT("trim start", cstr_match(cstr_trim_start(cstr("  x ")), cstr("x ")));
+    MUH_ASSERT("trim end", cstr_match(cstr_trim_end(cstr("  x ")), cstr("  x")));
+    MUH_ASSERT("only whitespace", len(cstr_trim(cstr(" \n \t "))) == 0);
+    MUH_ASSERT("empty", len(cstr_trim(cstr(""))) == 0);
+
+    char buffer[80];
+    for (size_t before = 0; before < 35; before++)
+        for (size_t after = 0; after < 35; after++)
+        {
+            memset(buffer, ' ', sizeof(buffer));
+            buffer[before] = 'a';
+            buffer[before + 2] = 'b';
+            cstr input = {before + 3 + after, buffer};
+            cstr trimmed = cstr_trim(input);
+            MUH_ASSERT("long trim", ptr(trimmed) == buffer + before && len(trimmed) == 3);
+
+            memset(buffer, '\t', sizeof(buffer));
+            MUH_ASSERT("long whitespace", len(cstr_trim(input)) == 0);
+        }
+}
+
+MUH_NIT_CASE(test_ascii_case)
+{
+    char input[300], lower[300], upper[300];
+
+    for (size_t i = 0; i < sizeof(input); i++)
+    {
+        input[i] = (char)i;
+        lower[i] = (char)tolower((unsigned char)input[i]);
+        upper[i] = (char)toupper((unsigned char)input[i]);
+    }
+
+    for (size_t offset = 0; offset < 40; offset++)
+    {
+        cstr part = {sizeof(input) - offset, input + offset};
+        cstring string = cstring_from("prefix", malloc_wrapper);
+
+        cstring_append_ascii_lower(&string, part);
+        MUH_ASSERT("lower differs from tolower", string.length == 6 + len(part) &&
+                                                     memcmp(string.inner + 6, lower + offset, len(part)) == 0);
+
+        cstring_clear(&string);
+        cstring_append_ascii_upper(&string, part);
+        MUH_ASSERT("upper differs from toupper", memcmp(string.inner, upper + offset, len(part)) == 0);
+
+        cstring_free(string);
+    }
+}
+
+cstring naive_replace_all(cstr haystack, cstr needle, cstr replacement)
+{
+    cstring result = cstring_from("", malloc_wrapper);
+    cstr found;
+
+    while (len(found = cstr_find_first(haystack, needle)) != 0)
+    {
+        cstring_append(&result, ((cstr){(size_t)(ptr(found) - ptr(haystack)), ptr(haystack)}));
+        cstring_append(&result, replacement);
+        haystack = (cstr){(size_t)(end(haystack) - end(found)), end(found)};
+    }
+
+    cstring_append(&result, haystack);
+    return result;
+}
+
+MUH_NIT_CASE(test_replace_all)
+{
+    const char *haystacks[] = {"", "no match here", "a-b-c", "--leading and trailing--", "aaaaa",
+                               "needle needle needle"};
+    const char *needles[] = {"-", "--", "aa", "needle", "x"};
+    const char *replacements[] = {"", "+", "==", "longer replacement"};
+
+    for (size_t h = 0; h < sizeof(haystacks) / sizeof(*haystacks); h++)
+        for (size_t n = 0; n < sizeof(needles) / sizeof(*needles); n++)
+            for (size_t r = 0; r < sizeof(replacements) / sizeof(*replacements); r++)
+            {
+                cstring expected = naive_replace_all(cstr(haystacks[h]), cstr(needles[n]), cstr(replacements[r]));
+                cstring string = cstring_from(haystacks[h], malloc_wrapper);
+
+                cstring_replace_all(&string, needles[n], replacements[r]);
+                MUH_ASSERT("replace_all differs", cstr_match(cstr(string), cstr(expected)));
+
+                cstring_free(string);
+                cstring_free(expected);
+            }
+
+    /* more matches than are remembered while counting */
+    cstring many = cstring_from("", malloc_wrapper);
+    for (int i = 0; i < 500; i++)
+        cstring_append(&many, "<x>");
+    cstring expected = naive_replace_all(cstr(many), cstr("x"), cstr("xyz"));
+
+    cstring_replace_all(&many, "x", "xyz");
+    MUH_ASSERT("many replacements differ", cstr_match(cstr(many), cstr(expected)));
+    MUH_ASSERT("output not sized exactly", many.capacity == many.length && many.length == 2500);
+
+    cstring_free(many);
+    cstring_free(expected);
+
+    /* same for a multi-byte needle, including adjacent and overlapping candidates */
+    cstring pairs = cstring_from("", malloc_wrapper);
+    for (int i = 0; i < 200; i++)
+        cstring_append(&pairs, i % 3 == 0 ? "abab;" : "aba,");
+    expected = naive_replace_all(cstr(pairs), cstr("ab"), cstr("<pair>"));
+
+    cstring_replace_all(&pairs, "ab", "<pair>");
+    MUH_ASSERT("many multi-byte replacements differ", cstr_match(cstr(pairs), cstr(expected)));
+    MUH_ASSERT("output not sized exactly", pairs.capacity == pairs.length);
+
+    cstring_free(pairs);
+    cstring_free(expected);
+
+    /* needle and replacement taken from the string that is being rewritten */
+    cstring aliased = cstring_from("abcXabcYabcZab", malloc_wrapper);
+    expected = naive_replace_all(cstr("abcXabcYabcZab"), cstr("abc"), cstr("ab"));
+    cstring_replace_all(&aliased, ((cstr){.length = 3, .inner = aliased.inner}),
+                        ((cstr){.length = 2, .inner = aliased.inner + 12}));
+    MUH_ASSERT("aliased in-place replacement differs", cstr_match(cstr(aliased), cstr(expected)));
+    cstring_free(expected);
+
+    expected = naive_replace_all(cstr(aliased), cstr("ab"), cstr("abXab"));
+    cstring_replace_all(&aliased, ((cstr){.length = 2, .inner = aliased.inner}),
+                        ((cstr){.length = 5, .inner = aliased.inner}));
+    MUH_ASSERT("aliased growing replacement differs", cstr_match(cstr(aliased), cstr(expected)));
+
+    cstring_free(aliased);
+    cstring_free(expected);
+}
+
+MUH_NIT_CASE(test_join_concat)
+{
+    allocator counting = {&counting_run, NULL};
+    cstr fields[] = {cstr("id"), cstr(""), cstr("name"), cstr("a longer field value")};
+    counted_allocations = 0;
+
+    cstring row = cstring_join(fields, 4, ",", counting);
+    MUH_ASSERT("wrong join", cstr_match(cstr(row), cstr("id,,name,a longer field value")));
+    MUH_ASSERT("join not exactly sized", row.capacity == row.length);
+    MUH_ASSERT("join allocated more than once", counted_allocations == 1);
+    cstring_free(row);
+
+    cstring single = cstring_join(fields, 1, cstr(" / "), malloc_wrapper);
+    MUH_ASSERT("single piece", cstr_match(cstr(single), cstr("id")));
+    cstring_free(single);
+
+    cstring none = cstring_join(fields, 0, ",", malloc_wrapper);
+    MUH_ASSERT("no pieces", len(none) == 0);
+    cstring_free(none);
+
+    cstr blanks[] = {cstr(""), cstr("")};
+    cstring blank = cstring_join(blanks, 2, "", malloc_wrapper);
+    MUH_ASSERT("empty pieces", len(blank) == 0);
+    cstring_free(blank);
+
+    cstring host = cstring_from("example.org", malloc_wrapper);
+    const char *segment = "users";
+    counted_allocations = 0;
+
+    cstring url = cstring_concat(counting, "https://", host, "/", segment, "/", fields[0]);
+    MUH_ASSERT("wrong concat", cstr_match(cstr(url), cstr("https://example.org/users/id")));
+    MUH_ASSERT("concat allocated more than once", counted_allocations == 1);
+    cstring_free(url);
+
+    cstring one = cstring_concat(malloc_wrapper, host);
+    MUH_ASSERT("concat of one", cstr_match(cstr(one), cstr(host)));
+    cstring_free(one);
+    cstring_free(host);
+}
+
+#ifdef __cplusplus
+
+static_assert(len("compile time"_cs) == 12, "literal length not constant");
+
+#if __cplusplus >= 201402L
+constexpr cstr_pattern static_needle = cstr_pattern_compile_constexpr("needle"_cs);
+static_assert(static_needle.shift[(unsigned char)'n'] == 5, "shift table not constant");
+static_assert(static_needle.shift[(unsigned char)'x'] == 6, "shift table not constant");
+#endif
+
+MUH_NIT_CASE(test_cpp_layer)
+{
+    constexpr cstr literal = "a\0b"_cs;
+    MUH_ASSERT("literal lost embedded nul", len(literal) == 3);
+
+    unique_cstring owned("short");
+    owned.append(", and now several appends longer");
+    MUH_ASSERT("wrong append", cstr_match(cstr(owned), cstr("short, and now several appends longer")));
+
+    unique_cstring moved(std::move(owned));
+    MUH_ASSERT("moved-from not empty", owned.size() == 0);
+    MUH_ASSERT("move lost contents", moved.size() == 37);
+
+    unique_cstring small("inline");
+    unique_cstring target;
+    target = std::move(small);
+    MUH_ASSERT("move assignment lost contents", cstr_match(target.view(), cstr("inline")));
+    MUH_ASSERT("moved-from not empty", small.size() == 0);
+
+    cstring released = moved.release();
+    MUH_ASSERT("release left contents", moved.size() == 0);
+    unique_cstring adopted = unique_cstring::adopt(released);
+    MUH_ASSERT("adopt lost contents", cstr_match(cstr(adopted), cstr(released)));
+
+#if __cplusplus >= 201402L
+    cstr haystack = cstr("where is the needle in here");
+    MUH_ASSERT("constexpr pattern miss", cstr_pattern_find_first(&static_needle, haystack).inner == haystack.inner + 13);
+#endif
+
+#ifdef CSTR_STRING_VIEW
+    std::string_view view = "view"_cs;
+    MUH_ASSERT("cstr to string_view", view == "view");
+    MUH_ASSERT("string_view to cstr", cstr_match(cstr(std::string_view("a\0b", 3)), literal));
+    std::string_view borrowed = target;
+    MUH_ASSERT("unique_cstring to string_view", borrowed == "inline");
+    unique_cstring from_view(std::string_view("from view"));
+    MUH_ASSERT("unique_cstring from string_view", cstr_match(cstr(from_view), cstr("from view")));
+#endif
+}
+
+#else
+
+MUH_NIT_CASE(test_cpp_layer, SKIP) {}
+
+#endif
+
 MUH_NIT_CASE(dumb_test, SKIP)
 {
     MUH_FAIL("this test always fails");
@@ -196,6 +1365,33 @@ MUH_NIT_CASE(init_fixture_test, FIXTURE(init_fixture))
     MUH_ASSERT("we got the wrong result", data->a == 42);
 }
 
+MUH_NIT_FIXTURE(haystack_sizes, TABLE(size_t),
+                {64},
+                {4096},
+                {1 << 20}, )
+
+MUH_NIT_BENCH(bench_pattern_find_first, FIXTURE(haystack_sizes))
+{
+    MUH_FIXTURE_BIND(haystack_sizes, ROW(size));
+
+    char *buffer = (char *)malloc(size);
+    memset(buffer, 'e', size);
+    memcpy(buffer + size - 6, "needle", 6);
+
+    cstr haystack = {size, buffer};
+    cstr_pattern pattern = cstr_pattern_compile(cstr("needle"));
+    bool found = cstr_pattern_find_first(&pattern, haystack).inner == buffer + size - 6;
+
+    MUH_BENCH_BYTES(size);
+    MUH_BENCH_LOOP
+    {
+        MUH_DO_NOT_OPTIMIZE(cstr_pattern_find_first(&pattern, haystack));
+    }
+
+    free(buffer);
+    MUH_ASSERT("needle not found at the end", found);
+}
+
 int main(int argc, const char **args)
 {
     muh_nit_case cases[] = MUH_CASES(
@@ -204,11 +1400,47 @@ int main(int argc, const char **args)
         test_cstr_from_string,
         test_cstring_from_cstr,
         test_cstring_append,
+        test_cstring_append_growth,
+        test_cstring_reserve_shrink_clear,
+        test_arena_allocator,
+        test_pool_allocator,
+        test_pool_allocator_threads,
+        test_cstring_assign,
+        test_rope,
         test_cstr_match,
+        test_cstr_match_long,
+        test_cstr_compare,
+        test_cstr_starts_ends_with,
+        test_cstr_match_ignore_case,
+        test_cstr_hash,
+        test_cstr_map,
+        test_interner,
+        test_interner_threads,
         test_find_first,
+        test_find_first_matches_kmp,
+        test_pattern_find_first,
+        test_pattern_horspool,
+        test_pattern_find_all,
+        test_multi_pattern,
+        test_multi_pattern_matches_contains,
         test_contains,
         test_for_word_space,
         test_for_word_sep,
+        test_split_matches_for_iter,
+        test_split_byte,
+        test_split_set,
+        test_mmap_file,
+        test_reader,
+        test_parallel_search,
+        test_parse_integers,
+        test_parse_float,
+        test_utf8,
+        test_trim,
+        test_ascii_case,
+        test_replace_all,
+        test_join_concat,
+        test_cpp_layer,
+        bench_pattern_find_first,
         dumb_test,
         fixture_test,
         wrapper_test,